@@ -41,9 +41,10 @@
 /*  chipKIT Max32 Dout pin 43 or (51 with JP4 in master);               */
 /*          unusable pins 29,50,52                                      */
 /*  Fubarino SD 1.5 Dout pin 26                                         */
-/*  WARNING: currently this code assumes SPI2. Of the chipKIT boards    */
-/*  this works on (WF32/Max32), the standard Arduino SPI just happens   */
-/*  to always be SPI2, but this is NOT generalized code!                */
+/*  By default this uses SPI2 and DMA channels 0 and 1. Of the chipKIT  */
+/*  boards this works on, the standard Arduino SPI just happens to      */
+/*  be SPI2. begin() can pick another SPI and DMA channel pair, so      */
+/*  several chains can each refresh on their own SPI at the same time.  */
 /*                                                                      */
 /*  The spec says that Dout Vih = .7Vdd and Vdd = 6v-7v However...      */
 /*  it seems to work with Vdd == 4.5v -> 5v and Vih == 3.3              */
@@ -52,25 +53,280 @@
 /*  up to .7Vdd. If your level shifter also inverts the data signal     */
 /*  you can specify fInvert=true on begin() to invert the 3.3v signal   */
 /*                                                                      */
+/*  This is the WS2812Pic32Driver, see WS2812Driver.h. The refresh      */
+/*  logic in the second half of the file only reaches the SPI and DMA   */
+/*  channels through the few routines in the first half, so a           */
+/*  WS2812_HOST build leaves the first half out and runs the same       */
+/*  refresh logic against the simulated channels in WS2812Host.cpp.     */
+/*                                                                      */
 /************************************************************************/
-#include <WProgram.h>
+#include <WS2812Driver.h>
+
+#if !defined(WS2812_HOST)
 
-#define TICKSPERSHORTCHECK  (5 * CORE_TICK_RATE)        // 5ms
-#define TICKSPERREFRESH     (30 * CORE_TICK_RATE)       // 30ms
-/* This is the clock rate for the SPI port. This is the fundamental unit that
- * the 1 and 0 high and low times are expressed in. This value of 3MHz was
- * picked because it allows for a low error rate on the various chipKIT
- * boards, and it still allows the timing requirements of the WS2812 LEDs to
- * be met. */
-#define WS2812_SPI_CLOCK_RATE   (3000000)
+#include <p32_defs.h>
 
 #define KVA_2_PA(v) (((uint32_t) (v)) & 0x1fffffff)
-#define read_count(dest) __asm__ __volatile__("mfc0 %0,$9" : "=r" (dest))
 
-static uint32_t zeros           = 0;
-static uint32_t ones            = 0xFFFFFFFF;
-static uint32_t tWS2812LastRun  = 0;
-static uint32_t fWS2812Updating = false;
+/* SPIxCON, DCHxCON and DCHxECON bits, the same for every SPI and DMA channel */
+#define SPICON_ON           (1 << 15)
+#define SPICON_MSTEN        (1 << 5)
+#define SPICON_ENHBUF       (1 << 16)
+#define SPICON_MODE32       (1 << 11)
+#define SPICON_STXISEL(__x) ((__x) << 2)
+#define DCHCON_CHEN         (1 << 7)
+#define DCHCON_CHCHN        (1 << 5)
+#define DCHCON_CHAEN        (1 << 4)
+#define DCHCON_CHPRI(__x)   (__x)
+#define DCHECON_CHSIRQ(__x) ((__x) << 8)
+#define DCHECON_SIRQEN      (1 << 4)
+#define DCHECON_CABORT      (1 << 6)
+#define DCHINT_CHSHIE       (1 << 22)
+#define DCHINT_CHBCIE       (1 << 19)
+#define DCHINT_CHSHIF       (1 << 6)
+#define DCHINT_CHBCIF       (1 << 3)
+
+/* The registers of one DMA channel, the channels follow each other from DCH0CON */
+typedef struct
+{
+    volatile p32_regset dchCon;
+    volatile p32_regset dchEcon;
+    volatile p32_regset dchInt;
+    volatile p32_regset dchSsa;
+    volatile p32_regset dchDsa;
+    volatile p32_regset dchSsiz;
+    volatile p32_regset dchDsiz;
+    volatile p32_regset dchSptr;
+    volatile p32_regset dchDptr;
+    volatile p32_regset dchCsiz;
+    volatile p32_regset dchCptr;
+    volatile p32_regset dchDat;
+} p32_dch;
+
+#define DCH(__i)    (((p32_dch *) &DCH0CON) + (__i))
+
+#if defined(_DMAC7_BASE_ADDRESS)
+    #define CDMACHANNELS    8
+#else
+    #define CDMACHANNELS    4
+#endif
+
+/* The interrupt numbers of SPIx and of DMA channel x. The SPI fault, 
+ * receive and transmit interrupts are always in that order. */
+#if defined(__PIC32MZ__)
+    #define SPI_TX_IRQ(__n)     _SPI##__n##_TX_VECTOR
+    #define DMA_IRQ(__i)        (_DMA0_VECTOR + (__i))
+    #define DMA_VECTOR(__i)     (_DMA0_VECTOR + (__i))
+#else
+    #define SPI_TX_IRQ(__n)     _SPI##__n##_TX_IRQ
+    #define DMA_IRQ(__i)        (_DMA0_IRQ + (__i))
+    #define DMA_VECTOR(__i)     (_DMA_0_VECTOR + (__i))
+#endif
+
+static WS2812HW * volatile pWS2812List = NULL;   // every WS2812HW that InitWS2812() has started
+
+/***    static p32_spi * SPIOf(uint32_t iSPI, uint32_t * pirqTX)
+ *
+ *    Parameters:
+ *          iSPI:   Which SPI, 1 for SPI1 and so on
+ *
+ *          pirqTX: Gets the SPI transmit interrupt number
+ *
+ *    Return Values:
+ *          The registers of SPIx, or NULL if this part has no SPIx
+ *
+ * ------------------------------------------------------------ */
+static p32_spi * SPIOf(uint32_t iSPI, uint32_t * pirqTX)
+{
+    switch(iSPI)
+    {
+#if defined(_SPI1_BASE_ADDRESS)
+        case 1:
+            *pirqTX = SPI_TX_IRQ(1);
+            return((p32_spi *) _SPI1_BASE_ADDRESS);
+#endif
+#if defined(_SPI2_BASE_ADDRESS)
+        case 2:
+            *pirqTX = SPI_TX_IRQ(2);
+            return((p32_spi *) _SPI2_BASE_ADDRESS);
+#endif
+#if defined(_SPI3_BASE_ADDRESS)
+        case 3:
+            *pirqTX = SPI_TX_IRQ(3);
+            return((p32_spi *) _SPI3_BASE_ADDRESS);
+#endif
+#if defined(_SPI4_BASE_ADDRESS)
+        case 4:
+            *pirqTX = SPI_TX_IRQ(4);
+            return((p32_spi *) _SPI4_BASE_ADDRESS);
+#endif
+#if defined(_SPI5_BASE_ADDRESS)
+        case 5:
+            *pirqTX = SPI_TX_IRQ(5);
+            return((p32_spi *) _SPI5_BASE_ADDRESS);
+#endif
+#if defined(_SPI6_BASE_ADDRESS)
+        case 6:
+            *pirqTX = SPI_TX_IRQ(6);
+            return((p32_spi *) _SPI6_BASE_ADDRESS);
+#endif
+        default:
+            break;
+    }
+
+    return(NULL);
+}
+
+/************************************************************************/
+/*                                                                      */
+/*  The SPI and DMA channels of a chain, as the refresh logic below     */
+/*  sees them. WS2812Host.cpp has the simulated versions.               */
+/*                                                                      */
+/************************************************************************/
+
+/***    uint32_t TicksWS2812(WS2812HW * pHW)
+ *
+ *    Parameters:
+ *          pHW:    The chain
+ *
+ *    Return Values:
+ *          The core timer count
+ *
+ * ------------------------------------------------------------ */
+uint32_t TicksWS2812(WS2812HW * pHW)
+{
+    uint32_t t = 0;
+
+    read_count(t);
+    return(t);
+}
+
+/***    uint32_t PatternOnWS2812(WS2812HW * pHW)
+ *
+ *    Parameters:
+ *          pHW:    The chain
+ *
+ *    Return Values:
+ *          True while the pattern DMA channel is enabled
+ *
+ * ------------------------------------------------------------ */
+uint32_t PatternOnWS2812(WS2812HW * pHW)
+{
+    return((DCH(pHW->iDMA)->dchCon.reg & DCHCON_CHEN) != 0);
+}
+
+/***    uint32_t ResetOnWS2812(WS2812HW * pHW)
+ *
+ *    Parameters:
+ *          pHW:    The chain
+ *
+ *    Return Values:
+ *          True while the reset DMA channel is enabled
+ *
+ * ------------------------------------------------------------ */
+uint32_t ResetOnWS2812(WS2812HW * pHW)
+{
+    return((DCH(pHW->iDMA + 1)->dchCon.reg & DCHCON_CHEN) != 0);
+}
+
+/***    void StartPatternWS2812(WS2812HW * pHW, uint8_t * pSwap)
+ *
+ *    Parameters:
+ *          pHW:    The chain
+ *
+ *          pSwap:  The pattern buffer to send from now on, or NULL 
+ *                  to send the one sent last time
+ *
+ *    Return Values:
+ *          None
+ *
+ *    Description:
+ *          Stops the reset DMA channel and starts the pattern DMA 
+ *          channel, called with interrupts off. A streaming chain
+ *          starts with its half way and block done flags clear.
+ *
+ * ------------------------------------------------------------ */
+void StartPatternWS2812(WS2812HW * pHW, uint8_t * pSwap)
+{
+    p32_dch * pPat = DCH(pHW->iDMA);
+
+    if(pHW->fStream)
+    {
+        pPat->dchInt.clr = DCHINT_CHSHIF | DCHINT_CHBCIF;
+    }
+
+    if(pSwap != NULL)
+    {
+        pPat->dchSsa.reg = KVA_2_PA(pSwap);
+    }
+    DCH(pHW->iDMA + 1)->dchCon.clr  = DCHCON_CHEN;
+    pPat->dchCon.set                = DCHCON_CHEN;
+}
+
+/***    void StopPatternWS2812(WS2812HW * pHW)
+ *
+ *    Parameters:
+ *          pHW:    The streaming chain
+ *
+ *    Return Values:
+ *          None
+ *
+ *    Description:
+ *          Aborts the pattern DMA channel going round the ring and 
+ *          starts the reset channel, as the chained reset channel 
+ *          would without streaming.
+ *
+ * ------------------------------------------------------------ */
+void StopPatternWS2812(WS2812HW * pHW)
+{
+    DCH(pHW->iDMA)->dchEcon.set     = DCHECON_CABORT;
+    DCH(pHW->iDMA + 1)->dchCon.set  = DCHCON_CHEN;
+}
+
+/***    void RingWS2812(WS2812HW * pHW)
+ *
+ *    Parameters:
+ *          pHW:    The chain, its ring halves set up by SetStream()
+ *
+ *    Return Values:
+ *          None
+ *
+ *    Description:
+ *          Has the pattern DMA channel go round the ring continuously and
+ *          interrupt at the end of each half, and unchains the reset channel.
+ *
+ * ------------------------------------------------------------ */
+void RingWS2812(WS2812HW * pHW)
+{
+    p32_dch * pPat = DCH(pHW->iDMA);
+
+    pPat->dchCon.reg    = DCHCON_CHAEN | DCHCON_CHPRI(0b11);
+    pPat->dchSsiz.reg   = 2 * pHW->cbHalf;
+    pPat->dchInt.reg    = DCHINT_CHSHIE | DCHINT_CHBCIE;
+    DCH(pHW->iDMA + 1)->dchCon.clr = DCHCON_CHCHN;
+}
+
+/***    uint32_t SentWS2812(WS2812HW * pHW)
+ *
+ *    Parameters:
+ *          pHW:    The chain
+ *
+ *    Return Values:
+ *          The bytes of the pattern buffer the pattern DMA channel has
+ *          read, DCHxSPTR, or 0 if it is not streaming a refresh
+ *
+ *    Description:
+ *
+ *      Lets an update that let the refresh go before it was fully
+ *      converted keep ahead of the DMA, see WS2812Core::setEarlyStart().
+ *
+ * ------------------------------------------------------------ */
+uint32_t SentWS2812(WS2812HW * pHW)
+{
+    p32_dch * pPat = DCH(pHW->iDMA);
+
+    return((pPat->dchCon.reg & DCHCON_CHEN) != 0 ? pPat->dchSptr.reg : 0);
+}
 
 /***    uint32_t WS2812TimerService(uint32_t curTime)
  *
@@ -82,44 +338,96 @@ static uint32_t fWS2812Updating = false;
  *
  *    Description:
  *          This is the CoreTimer routine to handle refreshing the 
- *          WS2812. This gets called every TICKSPERREFRESH
- *          unless it is behind on a refresh because of external factors
- *          then it is called every TICKSPERSHORTCHECK until it is refreshed.
+ *          WS2812 chains. There is one service for all of the chains,
+ *          it is called for whichever chain needs looking at first.
  *
  * ------------------------------------------------------------ */
 uint32_t WS2812TimerService(uint32_t curTime)
 {
-    uint32_t deltaTime = curTime - tWS2812LastRun;
- 
-    // it is time to refresh
-    if(!fWS2812Updating && !DCH0CONbits.CHEN && deltaTime >= TICKSPERREFRESH)
+    WS2812HW *  pHW         = pWS2812List;
+    uint32_t    nextTime    = curTime + TICKSPERREFRESH;
+
+    for(; pHW != NULL; pHW = pHW->pNext)
     {
-        uint32_t intState = disableInterrupts();
-        DCH1CONbits.CHEN = 0;
-        DCH0CONbits.CHEN = 1;
-        restoreInterrupts(intState);
+        uint32_t chainTime = ServiceWS2812(pHW, curTime);
 
-        tWS2812LastRun += (deltaTime / TICKSPERREFRESH) * TICKSPERREFRESH;
-        return(tWS2812LastRun + TICKSPERREFRESH);
+        if((int32_t) (chainTime - nextTime) < 0)
+        {
+            nextTime = chainTime;
+        }
     }
 
-    // if this is in a holding pattern for a really long time
-    // don't let delta get too big and wrap the uint32_t counter
-    if(deltaTime >= (2 * TICKSPERREFRESH))
-    {
-        tWS2812LastRun += TICKSPERREFRESH;
-        deltaTime -= TICKSPERREFRESH;
-    }
+    return(nextTime);
+}
 
-    // if we get here, we are trying to refresh and are running behind
-    // check more often to get the refresh done.
-    return(tWS2812LastRun + (((deltaTime / TICKSPERSHORTCHECK) + 1) * TICKSPERSHORTCHECK));
+/***    void KickWS2812(WS2812HW * pHW)
+ *
+ *    Parameters:
+ *          pHW:    The chain that has something for the core timer service
+ *
+ *    Return Values:
+ *          None
+ *
+ * ------------------------------------------------------------ */
+void KickWS2812(WS2812HW * pHW)
+{
+    callCoreTimerServiceNow(WS2812TimerService);
 }
 
+/***    void WS2812DMAService(void)
+ *
+ *    Parameters:
+ *          None
+ *
+ *    Return Values:
+ *          None
+ *
+ *    Description:
+ *          The interrupt routine for the block done interrupt of 
+ *          every pattern DMA channel. Notes when each chain's pattern 
+ *          buffer is out of the DMA, FrameDoneWS2812() takes it from there.
+ *          A streaming chain also interrupts half way through the ring,
+ *          see StreamWS2812().
+ *
+ * ------------------------------------------------------------ */
+void __USER_ISR WS2812DMAService(void)
+{
+    WS2812HW * pHW = pWS2812List;
+
+    for(; pHW != NULL; pHW = pHW->pNext)
+    {
+        p32_dch *   pPat    = DCH(pHW->iDMA);
+        uint32_t    flags   = pPat->dchInt.reg & (DCHINT_CHSHIF | DCHINT_CHBCIF);
+
+        if(pHW->fStream)
+        {
+            if(flags != 0)
+            {
+                pPat->dchInt.clr = flags;
+                StreamWS2812(pHW, ((flags & DCHINT_CHSHIF) != 0 ? WS2812_RING_HALF0 : 0) | 
+                                  ((flags & DCHINT_CHBCIF) != 0 ? WS2812_RING_HALF1 : 0));
+            }
+            clearIntFlag(DMA_IRQ(pHW->iDMA));
+        }
+        else if((flags & DCHINT_CHBCIF) != 0)
+        {
+            pPat->dchInt.clr = DCHINT_CHBCIF;
+            PatternDoneWS2812(pHW);
+            clearIntFlag(DMA_IRQ(pHW->iDMA));
+        }
+    }
+}
 
-/***    InitWS2812(uint8_t * pPatternBuffer, uint32_t cbPatternBuffer, uint32_t fInvert)
+/***    InitWS2812(WS2812HW * pHW, uint32_t iSPI, uint32_t iDMA, uint8_t * pPatternBuffer, uint32_t cbPatternBuffer, uint32_t fInvert, uint32_t spiClockRate, uint32_t fMode32)
  *
  *    Parameters:
+ *          pHW:            The state for this chain, kept until EndWS2812()
+ *
+ *          iSPI:           Which SPI to send on, 2 for SPI2 and so on
+ *
+ *          iDMA:           DMA channel iDMA streams the pattern buffer and
+ *                          DMA channel iDMA + 1 streams the reset cycle
+ *
  *          pPatternBuffer: A pointer to the pattern buffer for the DMA to use
  *                          The application allocates this and should be 
  *                          CBWS2812PATBUF(__cDevices) bytes long.
@@ -135,225 +443,960 @@ uint32_t WS2812TimerService(uint32_t curTime)
  *                          If fInvert is true, the SDO output signal will be inverted from what
  *                          the WS2812 would normally take. By default, the is "false".
  *
+ *          spiClockRate:   The SPI clock, __PIC32_pbClk / 2 divided by a whole number
+ *                          up to WS2812_MAX_SPI_DIVIDER / 2; WS2812_SPI_CLOCK_RATE
+ *                          unless WS2812::begin() picked one for a TIMING.
+ *
+ *          fMode32:        True to run the SPI in MODE32 and have the DMA move a
+ *                          word per transfer. pPatternBuffer must be word aligned and
+ *                          cbPatternBuffer whole words, in word order: each word is 
+ *                          shifted out MSb first, so its highest address byte first.
+ *
  *    Return Values:
- *          True if the core timer can be acquired and initialization succeeded.
+ *          True if the SPI and DMA channels exist and are not used by 
+ *          another chain, the SPI clock can be made, the core timer can be 
+ *          acquired and initialization succeeded.
  *
  *    Description:
  *
- *      Initialize the SPI to 20MHz which is a 50ns clock
- *      This will enable .35us pattern resolution in the SPI
- *      shift register.
+ *      Initialize the SPI to spiClockRate, the unit the
+ *      bit timings are counted in.
  *
  *      Also, initialize 2 DMA channels, one to shift out
  *      the pattern buffer, the other to maintain zeros
- *      for the restart / reset pattern (RES).
+ *      for the restart / reset pattern (RES). The reset channel
+ *      is chained to the pattern channel, so it takes over as 
+ *      soon as the pattern buffer is out.
+ *
+ *      Each chain has its own SPI and DMA channels and refreshes
+ *      on its own, so several chains refresh at the same time.
  *
  * ------------------------------------------------------------ */
-uint32_t InitWS2812(uint8_t * pPatternBuffer, uint32_t cbPatternBuffer, uint32_t fInvert)
+uint32_t InitWS2812(WS2812HW * pHW, uint32_t iSPI, uint32_t iDMA, uint8_t * pPatternBuffer, uint32_t cbPatternBuffer, uint32_t fInvert, uint32_t spiClockRate, uint32_t fMode32)
 {
-    // Disable SPI and DMA
-    SPI2CON             = 0;
-    DMACON              = 0;
+    WS2812HW *  pOther      = NULL;
+    p32_spi *   pSPI        = NULL;
+    p32_dch *   pPat        = NULL;
+    p32_dch *   pRes        = NULL;
+    uint32_t    irqTX       = 0;
+    uint32_t    intState    = 0;
+    uint32_t    cbCell      = fMode32 ? 4 : 1;
 
-    // set up SPI2
-    SPI2CONbits.MSTEN   = 1;    // SPI in master mode
-    SPI2CONbits.ENHBUF  = 1;    // enable 16 byte transfer buffer
-    SPI2CONbits.STXISEL = 0b10; // trigger DMA event when the ENBUF is half empty
-//    SPI2CONbits.DISSDI  = 1;  // Disable the SDI pin, allow it to be used for GPIO (not implemented on an MX6)
-    SPI2STAT            = 0;    // clear status register
-    SPI2BRG             = (__PIC32_pbClk / (2 * WS2812_SPI_CLOCK_RATE)) - 1;
-    
-#if defined(__PIC32MZ__)
-    IEC4bits.SPI2RXIE   = 0;    // disable SPI interrupts
-    IEC4bits.SPI2TXIE   = 0;    // disable SPI interrupts
-    IEC4bits.SPI2EIE    = 0;    // disable SPI interrupts
-    IFS4bits.SPI2RXIF   = 0;    // disable SPI interrupts
-    IFS4bits.SPI2TXIF   = 0;    // disable SPI interrupts
-    IFS4bits.SPI2EIF    = 0;    // disable SPI interrupts
-
-    IEC4bits.DMA0IE     = 0;
-    IFS4bits.DMA0IF     = 0;
-
-    IEC4bits.DMA1IE     = 0;
-    IFS4bits.DMA1IF     = 0;
-#else
-    IEC1bits.SPI2RXIE   = 0;    // disable SPI interrupts
-    IEC1bits.SPI2TXIE   = 0;    // disable SPI interrupts
-    IEC1bits.SPI2EIE    = 0;    // disable SPI interrupts
-    IFS1bits.SPI2RXIF   = 0;    // disable SPI interrupts
-    IFS1bits.SPI2TXIF   = 0;    // disable SPI interrupts
-    IFS1bits.SPI2EIF    = 0;    // disable SPI interrupts
-
-    IEC1bits.DMA0IE     = 0;
-    IFS1bits.DMA0IF     = 0;
-
-    IEC1bits.DMA1IE     = 0;
-    IFS1bits.DMA1IF     = 0;
-#endif
+    if(pHW->fInit || (pSPI = SPIOf(iSPI, &irqTX)) == NULL || iDMA + 1 >= CDMACHANNELS || 
+       spiClockRate > __PIC32_pbClk / 2 || spiClockRate < __PIC32_pbClk / WS2812_MAX_SPI_DIVIDER ||
+       (fMode32 && ((KVA_2_PA(pPatternBuffer) & 3) != 0 || (cbPatternBuffer & 3) != 0)))
+    {
+        return(0);
+    }
 
-    DMACONbits.ON       = 1;    // turn on the DMA controller
-#if defined(__PIC32MZ__)
-    IEC4bits.DMA0IE     = 0;    // disable DMA channel 0 interrupts
-    IFS4bits.DMA0IF     = 0;    // clear existing DMA channel 0 interrupt flag
-#else
-    IEC1bits.DMA0IE     = 0;    // disable DMA channel 0 interrupts
-    IFS1bits.DMA0IF     = 0;    // clear existing DMA channel 0 interrupt flag
-#endif
+    // the SPI and DMA channels must not belong to another chain
+    for(pOther = pWS2812List; pOther != NULL; pOther = pOther->pNext)
+    {
+        if(pOther->iSPI == iSPI || (pOther->iDMA <= iDMA + 1 && iDMA <= pOther->iDMA + 1U))
+        {
+            return(0);
+        }
+    }
 
-    // Set up DMA channel 0
-    DCH0CON             = 0;    // clear it
-    DCH0CONbits.CHAED   = 0;    // do not allow events to be remembered when disabled
-    DCH0CONbits.CHAEN   = 0;    // do not Allow continuous operation
-    DCH0CONbits.CHPRI   = 0b11; // highest priority
+    pPat = DCH(iDMA);
+    pRes = DCH(iDMA + 1);
 
-    DCH0ECON            = 0;    // clear it
-#if defined(__PIC32MZ__)
-    DCH0ECONbits.CHSIRQ = _SPI2_TX_VECTOR;// SPI2TX 1/2 empty notification
-#else
-    DCH0ECONbits.CHSIRQ = _SPI2_TX_IRQ;   // SPI2TX 1/2 empty notification
-#endif
-    DCH0ECONbits.SIRQEN = 1;    // enable IRQ transfer enables
+    // Disable SPI and DMA channels
+    pSPI->sxCon.reg     = 0;
+    pPat->dchCon.reg    = 0;
+    pRes->dchCon.reg    = 0;
 
-    DCH0INT             = 0;    // do not trigger any events
-    DCH0INTbits.CHBCIF  = 0;    // clear IF bit
+    // set up SPIx
+    pSPI->sxCon.reg     = SPICON_MSTEN          |   // SPI in master mode
+                          SPICON_ENHBUF         |   // enable 16 byte transfer buffer
+                          SPICON_STXISEL(0b10)  |   // trigger DMA event when the ENBUF is half empty
+                          (fMode32 ? SPICON_MODE32 : 0);    // shift words, or bytes
+    pSPI->sxStat.reg    = 0;                        // clear status register
+    pSPI->sxBrg.reg     = (__PIC32_pbClk / (2 * spiClockRate)) - 1;
 
-#if defined(__PIC32MZ__)
-    IPC33bits.DMA0IP     = 7;    // priority 7
-    IPC33bits.DMA1IS     = 0;    // sub priority 0
-#elif defined(__PIC32_PPS__)
-    IPC10bits.DMA0IP     = 7;    // priority 7
-    IPC10bits.DMA1IS     = 0;    // sub priority 0
-#else
-    IPC9bits.DMA0IP     = 7;    // priority 7
-    IPC9bits.DMA1IS     = 0;    // sub priority 0
-#endif
+    // disable the SPI fault, receive and transmit interrupts
+    clearIntEnable(irqTX - 2);
+    clearIntEnable(irqTX - 1);
+    clearIntEnable(irqTX);
+    clearIntFlag(irqTX - 2);
+    clearIntFlag(irqTX - 1);
+    clearIntFlag(irqTX);
 
-    DCH0SSA             = KVA_2_PA(pPatternBuffer); // source address of transfer
-    DCH0SSIZ            = cbPatternBuffer;          // number of bytes in source
-    DCH0DSA             = KVA_2_PA(&SPI2BUF);       // destination address is the SPI2 buffer
-    DCH0DSIZ            = 1;                        // 1 byte at the destination
-    DCH0CSIZ            = 1;                        // only transfer 1 byte per event
-
-    // Set up DMA channel 1
-    DCH1CON             = 0;    // clear it
-    DCH1CONbits.CHCHNS  = 0;    // allow chaining to the next higher priority DMA channel 0
-    DCH1CONbits.CHCHN   = 1;    // Turn on chaining
-    DCH1CONbits.CHAED   = 0;    // do not allow events to be remembered when disabled
-    DCH1CONbits.CHAEN   = 1;    // turn on continuous operation
-    DCH1CONbits.CHPRI   = 0b11; // highest priority
-
-    DCH1ECON            = 0;    // clear it
-#if defined(__PIC32MZ__)
-    DCH1ECONbits.CHSIRQ = _SPI2_TX_VECTOR;   // SPI2TX 1/2 empty notification
-#else
-    DCH1ECONbits.CHSIRQ = _SPI2_TX_IRQ;   // SPI2TX 1/2 empty notification
-#endif
-    DCH1ECONbits.SIRQEN = 1;    // enable IRQ transfer enables
+    // the pattern DMA channel interrupts when it is done, the reset channel does not
+    clearIntEnable(DMA_IRQ(iDMA));
+    clearIntFlag(DMA_IRQ(iDMA));
+    clearIntEnable(DMA_IRQ(iDMA + 1));
+    clearIntFlag(DMA_IRQ(iDMA + 1));
+    setIntVector(DMA_VECTOR(iDMA), WS2812DMAService);
+    setIntPriority(DMA_VECTOR(iDMA), 5, 0);
 
-    DCH1INT             = 0;    // do not trigger any events
+    DMACONSET           = _DMACON_ON_MASK;          // turn on the DMA controller
 
-    if(fInvert)
-    {
-        DCH1SSA         = KVA_2_PA(&ones);     // refresh cycle is inverted streaming 1s
-    }
-    else
-    {
-        DCH1SSA         = KVA_2_PA(&zeros);     // normal refresh cycle streaming 0s
-    }
-    DCH1SSIZ            = 1;                    // number of bytes in source
+    // Set up the pattern DMA channel, no events remembered when disabled, 
+    // no continuous operation and highest priority
+    pPat->dchCon.reg    = DCHCON_CHPRI(0b11);
+    pPat->dchEcon.reg   = DCHECON_CHSIRQ(irqTX) | DCHECON_SIRQEN;  // SPIx TX 1/2 empty notification
+    pPat->dchInt.reg    = DCHINT_CHBCIE;            // interrupt when the block is done
 
-    DCH1DSA             = KVA_2_PA(&SPI2BUF);   // destination address is the SPI2 buffer
-    DCH1DSIZ            = 1;                    // 1 byte at the destination
-    DCH1CSIZ            = 1;                    // only transfer 1 byte per event
+    pPat->dchSsa.reg    = KVA_2_PA(pPatternBuffer); // source address of transfer
+    pPat->dchSsiz.reg   = cbPatternBuffer;          // number of bytes in source
+    pPat->dchDsa.reg    = KVA_2_PA(&pSPI->sxBuf.reg);   // destination address is the SPIx buffer
+    pPat->dchDsiz.reg   = cbCell;                   // 1 byte, or word, at the destination
+    pPat->dchCsiz.reg   = cbCell;                   // only transfer 1 byte, or word, per event
 
-    // initial time for the core service routine
-    read_count(tWS2812LastRun);
+    // Set up the reset DMA channel, chained to the next higher priority 
+    // DMA channel, which is the pattern channel, continuous and highest priority
+    pRes->dchCon.reg    = DCHCON_CHCHN | DCHCON_CHAEN | DCHCON_CHPRI(0b11);
+    pRes->dchEcon.reg   = DCHECON_CHSIRQ(irqTX) | DCHECON_SIRQEN;  // SPIx TX 1/2 empty notification
+    pRes->dchInt.reg    = 0;                        // do not trigger any events
+
+    // refresh cycle is streaming 0s, or 1s when inverted, see SetupWS2812()
+    pRes->dchSsa.reg    = KVA_2_PA(&pHW->level);
+    pRes->dchSsiz.reg   = cbCell;                   // number of bytes in source
+
+    pRes->dchDsa.reg    = KVA_2_PA(&pSPI->sxBuf.reg);   // destination address is the SPIx buffer
+    pRes->dchDsiz.reg   = cbCell;                   // 1 byte, or word, at the destination
+    pRes->dchCsiz.reg   = cbCell;                   // only transfer 1 byte, or word, per event
 
-    // attach the core service routine
-    if(attachCoreTimerService(WS2812TimerService))
+    pHW->iSPI           = iSPI;
+    pHW->iDMA           = iDMA;
+    SetupWS2812(pHW, pPatternBuffer, cbPatternBuffer, fInvert, spiClockRate, fMode32);
+
+    // Enable the reset DMA channel and SPIx; just zero output
+    pRes->dchCon.set    = DCHCON_CHEN;
+    pSPI->sxCon.set     = SPICON_ON;
+
+    // add the chain to the core service routine, attach it for the first chain
+    intState = disableInterrupts();
+    pHW->pNext  = pWS2812List;
+    pWS2812List = pHW;
+    restoreInterrupts(intState);
+
+    if(pHW->pNext != NULL || attachCoreTimerService(WS2812TimerService))
     {
-        // Enable DMA channel 1 and SPI 2
-        // we enable in the refresh cycle until a pattern
-        // is loaded in the main sketch.
-        fWS2812Updating = true;
-#if defined(__PIC32MZ__)
-        IFS4bits.DMA0IF     = 0;
-        IEC4bits.DMA0IE     = 1;
-#else
-        IFS1bits.DMA0IF     = 0;
-        IEC1bits.DMA0IE     = 1;
-#endif
-        DCH1CONbits.CHEN    = 1;    // turn DMA channel 1 ON; just zero output
-        SPI2CONbits.ON      = 1;
+        setIntEnable(DMA_IRQ(iDMA));
+        pHW->fInit = true;
         return(1);                  // success
     }
 
-    // Things are not good, disable SPI and DMA
-    SPI2CON             = 0;
-    DMACON              = 0;
+    // Things are not good, disable SPI and DMA, this was the only chain
+    pWS2812List         = NULL;
+    clearIntVector(DMA_VECTOR(iDMA));
+    pRes->dchCon.reg    = 0;
+    pSPI->sxCon.reg     = 0;
 
     // error out
     return(0);
 }
 
-/***    void EndWS2812(void)
+/***    void EndWS2812(WS2812HW * pHW)
  *
  *    Parameters:
- *          None
+ *          pHW:    The chain to stop
  *
  *    Return Values:
  *          None
  *
  *    Description:
  *
- *      Disables the WS2812 controller
+ *      Disables the WS2812 controller for this chain and releases its
+ *      SPI and DMA channels. The core timer service is detached and
+ *      the DMA controller turned off after the last chain.
  *
  * ------------------------------------------------------------ */
-void EndWS2812(void)
+void EndWS2812(WS2812HW * pHW)
 {
-    SPI2CON             = 0;
-    DMACON              = 0;
-    DCH0CONbits.CHEN    = 0;
-    DCH1CONbits.CHEN    = 0;
+    WS2812HW * volatile *   ppHW        = &pWS2812List;
+    uint32_t                intState    = 0;
+    uint32_t                irqTX       = 0;
+
+    if(!pHW->fInit)
+    {
+        return;
+    }
+
+    intState = disableInterrupts();
+    for(; *ppHW != NULL; ppHW = &(*ppHW)->pNext)
+    {
+        if(*ppHW == pHW)
+        {
+            *ppHW = pHW->pNext;
+            break;
+        }
+    }
+    restoreInterrupts(intState);
+
+    SPIOf(pHW->iSPI, &irqTX)->sxCon.reg     = 0;
+    DCH(pHW->iDMA)->dchCon.reg              = 0;
+    DCH(pHW->iDMA)->dchInt.reg              = 0;
+    DCH(pHW->iDMA + 1)->dchCon.reg          = 0;
+    clearIntEnable(DMA_IRQ(pHW->iDMA));
+    clearIntFlag(DMA_IRQ(pHW->iDMA));
+    clearIntVector(DMA_VECTOR(pHW->iDMA));
+
+    if(pWS2812List == NULL)
+    {
+        detachCoreTimerService(WS2812TimerService);
+        DMACON = 0;
+    }
+
+    pHW->fStream    = false;
+    pHW->fInit      = false;
 }
 
-/***    uint32_t StartUpdate(void)
+#endif // !WS2812_HOST
+
+/************************************************************************/
+/*                                                                      */
+/*  The refresh logic of one chain, the same for the PIC32 and for a    */
+/*  WS2812_HOST build. It runs from the core timer service, the DMA     */
+/*  interrupt and the sketch, and only reaches the hardware through     */
+/*  the routines above.                                                 */
+/*                                                                      */
+/************************************************************************/
+
+/***    static uint32_t TicksToShift(WS2812HW * pHW, uint32_t cb)
  *
  *    Parameters:
- *          None
+ *          pHW:    The chain, for its SPI clock rate
+ *
+ *          cb:     A number of bytes
  *
  *    Return Values:
- *          Return true when the DMA is streaming the refresh cycle,
- *          false if still streaming the pattern out
+ *          The core timer ticks it takes the SPI to shift out cb bytes
+ *          followed by the reset level for WS2812_RESET_US
  *
- *    Description:
+ * ------------------------------------------------------------ */
+static uint32_t TicksToShift(WS2812HW * pHW, uint32_t cb)
+{
+    return((uint32_t) ((((uint64_t) cb) * 8 * 1000 * CORE_TICK_RATE) / pHW->spiClockRate) + 
+           ((WS2812_RESET_US * CORE_TICK_RATE) / 1000));
+}
+
+/***    static void FillHalfWS2812(WS2812HW * pHW, uint8_t * pb)
  *
- *      Attempt to start an update cycle, hold the core timer
- *      service routine in the refresh cycle so the main pattern
- *      buffer can be updated.
+ *    Parameters:
+ *          pHW:    The streaming chain
+ *
+ *          pb:     The half of the ring to fill
+ *
+ *    Return Values:
+ *          None
+ *
+ *    Description:
+ *          Puts the next half of the refresh into pb, past the end
+ *          of the refresh the half is padded with the reset level.
  *
  * ------------------------------------------------------------ */
-uint32_t StartUpdate(void)
+static void FillHalfWS2812(WS2812HW * pHW, uint8_t * pb)
 {
-    fWS2812Updating = DCH1CONbits.CHEN;
-    return(fWS2812Updating);
+    uint32_t cb = 0;
+
+    if(pHW->ibFill < pHW->cbFrame)
+    {
+        cb = pHW->cbFrame - pHW->ibFill;
+        if(cb > pHW->cbHalf)
+        {
+            cb = pHW->cbHalf;
+        }
+
+        pHW->pfnFill(pHW->pFillContext, pb, pHW->ibFill, cb);
+        pHW->ibFill += cb;
+    }
+
+    memset(pb + cb, (uint8_t) pHW->level, pHW->cbHalf - cb);
 }
 
-/***    void EndUpdate(void)
+/***    static uint32_t RefreshWS2812(WS2812HW * pHW, uint32_t curTime)
  *
  *    Parameters:
- *          None
+ *          pHW:        The chain to refresh
+ *
+ *          curTime:    The current core timer time
  *
  *    Return Values:
- *          none
+ *          The next core timer time this chain needs looking at
  *
  *    Description:
+ *          Refreshes one chain every tRefresh unless it is behind
+ *          on a refresh because of external factors, then it is checked
+ *          every TICKSPERSHORTCHECK until it is refreshed. In push on
+ *          commit mode a committed update is also sent as soon as the
+ *          last refresh and its reset period are out.
+ *
+ *          A refresh never starts until tGap after the last one started,
+ *          the pattern buffer and the SPI FIFO have to be shifted out and 
+ *          the chain has to see the reset level for WS2812_RESET_US. 
+ *          A refresh with a new update also has to have been reported by 
+ *          FrameDoneWS2812(), and has the chain looked at again once it
+ *          is out so FrameDoneWS2812() reports it then. FrameDoneWS2812()
+ *          runs first in the service, before this has started the refresh.
  *
- *      Release the core timer service to update from the pattern buffer
+ *          When double buffering, this is also where the pattern DMA
+ *          channel is pointed at a newly committed pattern buffer. The 
+ *          channel is idle between refreshes, so the buffer it was 
+ *          streaming is free as soon as the source address is changed.
  *
  * ------------------------------------------------------------ */
-void EndUpdate(void)
+static uint32_t RefreshWS2812(WS2812HW * pHW, uint32_t curTime)
 {
-    fWS2812Updating = false;
-}
+    uint32_t    deltaTime   = curTime - pHW->tLastRun;
+    uint32_t    fReady      = !pHW->fUpdating && !pHW->fNewFrame && !PatternOnWS2812(pHW) && (curTime - pHW->tStart) >= pHW->tGap;
+ 
+    // it is time to refresh, or there is an update to push out
+    if(fReady && (deltaTime >= pHW->tRefresh || (pHW->fPush && pHW->fPending)))
+    {
+        uint32_t intState = 0;
+
+        // streaming, the first two halves go in the ring while the channel is idle
+        if(pHW->fStream)
+        {
+            pHW->ibFill     = 0;
+            pHW->iHalfOut   = 0;
+            FillHalfWS2812(pHW, pHW->pRing);
+            FillHalfWS2812(pHW, pHW->pRing + pHW->cbHalf);
+        }
+
+        intState = disableInterrupts();
+        StartPatternWS2812(pHW, pHW->pSwap);
+        pHW->pSwap = NULL;
+        restoreInterrupts(intState);
+
+        pHW->tStart     = curTime;
+        pHW->fOut       = false;
+        pHW->fNewFrame  = pHW->fPending;
+        pHW->fPending   = false;
+        pHW->cRefreshes++;
+        TraceWS2812(pHW->pTrace, curTime, WS2812_TRACE_DMAON, pHW->fNewFrame, 0);
+
+        // the refresh went late, and whole periods may have gone by as well
+        if(pHW->fBehind)
+        {
+            pHW->fBehind = false;
+            pHW->cLate++;
+            if(curTime - pHW->tDue > pHW->tMaxLate)
+            {
+                pHW->tMaxLate = curTime - pHW->tDue;
+            }
+        }
+        if(deltaTime >= (2 * pHW->tRefresh))
+        {
+            pHW->cSkipped += (deltaTime / pHW->tRefresh) - 1;
+        }
 
+        // the next update can go as soon as this refresh is out
+        if(pHW->fPush)
+        {
+            pHW->tLastRun = curTime;
+            return(curTime + pHW->tGap);
+        }
+
+        pHW->tLastRun += (deltaTime / pHW->tRefresh) * pHW->tRefresh;
+
+        // a new update is reported as soon as it is out, not a refresh later
+        if(pHW->fNewFrame && (int32_t) (pHW->tLastRun + pHW->tRefresh - (curTime + pHW->tGap)) > 0)
+        {
+            return(curTime + pHW->tGap);
+        }
+        return(pHW->tLastRun + pHW->tRefresh);
+    }
+
+    // not due yet, this was an early call for an update
+    if(deltaTime < pHW->tRefresh && !(pHW->fPush && pHW->fPending))
+    {
+        return(pHW->tLastRun + pHW->tRefresh);
+    }
+
+    // due and not ready, late from here until it goes
+    if(deltaTime >= pHW->tRefresh && !pHW->fBehind)
+    {
+        pHW->fBehind    = true;
+        pHW->tDue       = pHW->tLastRun + pHW->tRefresh;
+        TraceWS2812(pHW->pTrace, curTime, WS2812_TRACE_LATE, 
+            (pHW->fUpdating ? WS2812_LATE_UPDATING : 0) | 
+            (pHW->fNewFrame ? WS2812_LATE_NEWFRAME : 0) | 
+            (PatternOnWS2812(pHW) ? WS2812_LATE_DMA : 0) | 
+            ((curTime - pHW->tStart) < pHW->tGap ? WS2812_LATE_GAP : 0), 0);
+    }
+
+    // if this is in a holding pattern for a really long time
+    // don't let delta get too big and wrap the uint32_t counter
+    if(deltaTime >= (2 * pHW->tRefresh))
+    {
+        pHW->tLastRun += pHW->tRefresh;
+        deltaTime -= pHW->tRefresh;
+        pHW->cSkipped++;
+    }
+
+    // an update waiting on the last refresh goes when that is out
+    if(pHW->fPush && pHW->fPending && (curTime - pHW->tStart) < pHW->tGap)
+    {
+        return(pHW->tStart + pHW->tGap);
+    }
+
+    // if we get here, we are trying to refresh and are running behind
+    // check more often to get the refresh done.
+    return(pHW->tLastRun + (((deltaTime / TICKSPERSHORTCHECK) + 1) * TICKSPERSHORTCHECK));
+}
+
+/***    static uint32_t FrameDoneWS2812(WS2812HW * pHW, uint32_t curTime)
+ *
+ *    Parameters:
+ *          pHW:        The chain to check
+ *
+ *          curTime:    The current core timer time
+ *
+ *    Return Values:
+ *          The next core timer time this chain needs looking at
+ *
+ *    Description:
+ *          Reports a refresh with a new update once it is on the chain.
+ *          PatternDoneWS2812() says when the pattern DMA channel is done,
+ *          after that the SPI FIFO has to empty and the chain has to see
+ *          the reset level before the update is latched. Then the frame
+ *          done routine is called, from the core timer service.
+ *
+ * ------------------------------------------------------------ */
+static uint32_t FrameDoneWS2812(WS2812HW * pHW, uint32_t curTime)
+{
+    if(!pHW->fNewFrame)
+    {
+        return(curTime + TICKSPERREFRESH);
+    }
+
+    // still streaming, the DMA interrupt should be in by tGap
+    if(!pHW->fOut)
+    {
+        if((int32_t) (pHW->tStart + pHW->tGap - curTime) > 0)
+        {
+            return(pHW->tStart + pHW->tGap);
+        }
+
+        if(PatternOnWS2812(pHW))
+        {
+            return(curTime + pHW->tLatch);
+        }
+
+        // the interrupt was missed, but the channel is done
+        pHW->tOut   = curTime - pHW->tLatch;
+        pHW->fOut   = true;
+    }
+
+    if((curTime - pHW->tOut) < pHW->tLatch)
+    {
+        return(pHW->tOut + pHW->tLatch);
+    }
+
+    pHW->fNewFrame = false;
+    if(!pHW->fPending)
+    {
+        pHW->fFrameBusy = false;
+    }
+    TraceWS2812(pHW->pTrace, curTime, WS2812_TRACE_FRAMEDONE, 0, 0);
+
+    if(pHW->pfnFrameDone != NULL)
+    {
+        pHW->pfnFrameDone(pHW->pFrameDoneContext);
+    }
+
+    return(curTime + TICKSPERREFRESH);
+}
+
+/***    uint32_t ServiceWS2812(WS2812HW * pHW, uint32_t curTime)
+ *
+ *    Parameters:
+ *          pHW:        The chain
+ *
+ *          curTime:    The current core timer time
+ *
+ *    Return Values:
+ *          The next core timer time this chain needs looking at
+ *
+ *    Description:
+ *          The core timer service for one chain, WS2812TimerService()
+ *          calls it for every chain.
+ *
+ * ------------------------------------------------------------ */
+uint32_t ServiceWS2812(WS2812HW * pHW, uint32_t curTime)
+{
+    uint32_t doneTime   = FrameDoneWS2812(pHW, curTime);
+    uint32_t chainTime  = RefreshWS2812(pHW, curTime);
+
+    return(((int32_t) (doneTime - chainTime) < 0) ? doneTime : chainTime);
+}
+
+/***    void StreamWS2812(WS2812HW * pHW, uint32_t halves)
+ *
+ *    Parameters:
+ *          pHW:    The streaming chain
+ *
+ *          halves: WS2812_RING_HALF0 and / or WS2812_RING_HALF1, the
+ *                  halves of the ring the pattern DMA channel has 
+ *                  finished since the last call
+ *
+ *    Return Values:
+ *          None
+ *
+ *    Description:
+ *          The pattern DMA channel goes round the ring until this stops
+ *          it. Each time it is done with a half, that half is refilled
+ *          with the refresh two halves on while the DMA reads the other.
+ *          Once the last of the refresh is read the DMA is on the padding
+ *          after it, so the channel is stopped and the reset channel 
+ *          started, as the chained reset channel would without streaming.
+ *          Called from the DMA interrupt.
+ *
+ *          If both halves are done the interrupt was so late the DMA has
+ *          come back round to the half it was to refill, and is sending
+ *          what it sent two halves ago. Unless that is past the end of
+ *          the refresh, the refresh is stopped there and counted in 
+ *          cUnderruns; a new update in it is sent again, and only 
+ *          reported once it has gone out whole.
+ *
+ * ------------------------------------------------------------ */
+void StreamWS2812(WS2812HW * pHW, uint32_t halves)
+{
+    uint32_t cDone = ((halves & WS2812_RING_HALF0) != 0) + ((halves & WS2812_RING_HALF1) != 0);
+
+    if(cDone == 0)
+    {
+        return;
+    }
+
+    if(pHW->iHalfOut + cDone >= pHW->cHalves || cDone > 1)
+    {
+        StopPatternWS2812(pHW);
+        pHW->tOut       = TicksWS2812(pHW);
+        pHW->fOut       = true;
+        pHW->tDMABusy  += pHW->tOut - pHW->tStart;
+        TraceWS2812(pHW->pTrace, pHW->tOut, WS2812_TRACE_DMAOFF, 0, 0);
+
+        // the DMA is sending a stale half and the rest of the refresh is lost
+        if(pHW->iHalfOut + cDone < pHW->cHalves)
+        {
+            pHW->cUnderruns++;
+            TraceWS2812(pHW->pTrace, pHW->tOut, WS2812_TRACE_UNDERRUN, 0, pHW->iHalfOut + cDone);
+            if(pHW->fNewFrame)
+            {
+                pHW->fNewFrame  = false;
+                pHW->fPending   = true;
+            }
+        }
+        return;
+    }
+
+    pHW->iHalfOut++;
+    FillHalfWS2812(pHW, (halves & WS2812_RING_HALF0) != 0 ? pHW->pRing : pHW->pRing + pHW->cbHalf);
+}
+
+/***    void PatternDoneWS2812(WS2812HW * pHW)
+ *
+ *    Parameters:
+ *          pHW:    The chain, not streaming
+ *
+ *    Return Values:
+ *          None
+ *
+ *    Description:
+ *          Notes that the pattern DMA channel is done with the pattern 
+ *          buffer, the chained reset channel has the chain from here.
+ *          Called from the DMA interrupt.
+ *
+ * ------------------------------------------------------------ */
+void PatternDoneWS2812(WS2812HW * pHW)
+{
+    pHW->tOut       = TicksWS2812(pHW);
+    pHW->fOut       = true;
+    pHW->tDMABusy  += pHW->tOut - pHW->tStart;
+    TraceWS2812(pHW->pTrace, pHW->tOut, WS2812_TRACE_DMAOFF, 0, 0);
+}
+
+/***    void SetupWS2812(WS2812HW * pHW, uint8_t * pPatternBuffer, uint32_t cbPatternBuffer, uint32_t fInvert, uint32_t spiClockRate, uint32_t fMode32)
+ *
+ *    Parameters:
+ *          pHW:            The chain
+ *
+ *          pPatternBuffer: What the pattern DMA channel streams
+ *
+ *          cbPatternBuffer: Its size
+ *
+ *          fInvert:        The reset level is all 1s, not all 0s
+ *
+ *          spiClockRate:   What the SPI shifts out at
+ *
+ *          fMode32:        The SPI and DMA move words
+ *
+ *    Return Values:
+ *          None
+ *
+ *    Description:
+ *
+ *      Sets the chain up to refresh from the pattern buffer, with the
+ *      refresh held until the first update is committed. InitWS2812()
+ *      calls this once the SPI and DMA channels are set up.
+ *
+ * ------------------------------------------------------------ */
+void SetupWS2812(WS2812HW * pHW, uint8_t * pPatternBuffer, uint32_t cbPatternBuffer, uint32_t fInvert, uint32_t spiClockRate, uint32_t fMode32)
+{
+    pHW->level          = fInvert ? 0xFFFFFFFF : 0;
+    pHW->spiClockRate   = spiClockRate;
+    pHW->fMode32        = fMode32;
+    pHW->pSwap          = NULL;
+    pHW->fPending       = false;
+    pHW->fPush          = false;
+    pHW->fNewFrame      = false;
+    pHW->fOut           = false;
+    pHW->fFrameBusy     = false;
+    pHW->pfnFrameDone   = NULL;
+    pHW->tRefresh       = TICKSPERREFRESH;
+    pHW->fStream        = false;
+    pHW->pRing          = pPatternBuffer;
+    pHW->cbHalf         = cbPatternBuffer / 2;
+    pHW->fBehind        = false;
+    pHW->pTrace         = NULL;
+    ClearStatsWS2812(pHW);
+
+    // a refresh is out once the pattern buffer and the SPI FIFO are shifted out
+    // and the reset level has been held for WS2812_RESET_US
+    pHW->tGap           = TicksToShift(pHW, cbPatternBuffer + CBSPIFIFO);
+    pHW->tLatch         = TicksToShift(pHW, CBSPIFIFO);
+
+    // we enable in the refresh cycle until a pattern
+    // is loaded in the main sketch.
+    pHW->fUpdating      = true;
+
+    // initial time for the core service routine
+    pHW->tLastRun       = TicksWS2812(pHW);
+    pHW->tStart         = pHW->tLastRun - pHW->tGap;
+}
+
+/***    uint32_t StartUpdate(WS2812HW * pHW)
+ *
+ *    Parameters:
+ *          pHW:    The chain to update
+ *
+ *    Return Values:
+ *          Return true when the DMA is streaming the refresh cycle,
+ *          false if still streaming the pattern out
+ *
+ *    Description:
+ *
+ *      Attempt to start an update cycle, hold the core timer
+ *      service routine in the refresh cycle so the main pattern
+ *      buffer can be updated.
+ *
+ * ------------------------------------------------------------ */
+uint32_t StartUpdate(WS2812HW * pHW)
+{
+    pHW->fUpdating = ResetOnWS2812(pHW);
+    return(pHW->fUpdating);
+}
+
+/***    void EndUpdate(WS2812HW * pHW)
+ *
+ *    Parameters:
+ *          pHW:    The chain being updated
+ *
+ *    Return Values:
+ *          none
+ *
+ *    Description:
+ *
+ *      Release the core timer service to update from the pattern buffer,
+ *      at once in push on commit mode.
+ *
+ * ------------------------------------------------------------ */
+void EndUpdate(WS2812HW * pHW)
+{
+    pHW->fUpdating  = false;
+    pHW->fFrameBusy = true;
+    pHW->fPending   = true;
+    if(pHW->fPush)
+    {
+        KickWS2812(pHW);
+    }
+}
+
+/***    uint32_t StartSwapUpdate(WS2812HW * pHW)
+ *
+ *    Parameters:
+ *          pHW:    The chain to update
+ *
+ *    Return Values:
+ *          Return true when the back pattern buffer is free,
+ *          false if it is still waiting to be swapped in by the
+ *          core timer service routine.
+ *
+ *    Description:
+ *
+ *      The double buffered form of StartUpdate(). The refresh is not held,
+ *      the pattern DMA channel keeps streaming the front pattern buffer while
+ *      the back pattern buffer is updated.
+ *
+ * ------------------------------------------------------------ */
+uint32_t StartSwapUpdate(WS2812HW * pHW)
+{
+    return(pHW->pSwap == NULL);
+}
+
+/***    void SwapUpdate(WS2812HW * pHW, uint8_t * pPatternBuffer)
+ *
+ *    Parameters:
+ *          pHW:            The chain being updated
+ *
+ *          pPatternBuffer: The back pattern buffer that was just updated
+ *
+ *    Return Values:
+ *          none
+ *
+ *    Description:
+ *
+ *      The double buffered form of EndUpdate(). Have the core timer service
+ *      routine switch the pattern DMA channel to pPatternBuffer at the next refresh.
+ *      The old front pattern buffer becomes the back pattern buffer once
+ *      StartSwapUpdate() returns true.
+ *
+ * ------------------------------------------------------------ */
+void SwapUpdate(WS2812HW * pHW, uint8_t * pPatternBuffer)
+{
+    pHW->pSwap      = pPatternBuffer;
+    pHW->fUpdating  = false;
+    pHW->fFrameBusy = true;
+    pHW->fPending   = true;
+    if(pHW->fPush)
+    {
+        KickWS2812(pHW);
+    }
+}
+
+/***    void SetRefresh(WS2812HW * pHW, uint32_t tRefresh, uint32_t fPush)
+ *
+ *    Parameters:
+ *          pHW:        The chain to set up
+ *
+ *          tRefresh:   Core timer ticks between refreshes, not 0
+ *
+ *          fPush:      True to send an update as soon as it is committed
+ *                      and the last refresh is out, instead of at the next
+ *                      refresh.
+ *
+ *    Return Values:
+ *          none
+ *
+ *    Description:
+ *
+ *      The refresh keeps the chain showing the pattern buffer through
+ *      noise on the data line; pushing on commit is what sets how soon
+ *      an update is shown. The new period starts from the last refresh.
+ *
+ * ------------------------------------------------------------ */
+void SetRefresh(WS2812HW * pHW, uint32_t tRefresh, uint32_t fPush)
+{
+    uint32_t intState = disableInterrupts();
+
+    pHW->tRefresh   = tRefresh;
+    pHW->fPush      = fPush;
+    restoreInterrupts(intState);
+
+    if(pHW->fInit)
+    {
+        KickWS2812(pHW);
+    }
+}
+
+/***    void SetFrameDone(WS2812HW * pHW, PFNWS2812FRAMEDONE pfnFrameDone, void * pContext)
+ *
+ *    Parameters:
+ *          pHW:            The chain
+ *
+ *          pfnFrameDone:   Called with pContext when an update is on the 
+ *                          chain, or NULL
+ *
+ *          pContext:       Passed to pfnFrameDone
+ *
+ *    Return Values:
+ *          none
+ *
+ *    Description:
+ *
+ *      pfnFrameDone is called from the core timer service, so it must
+ *      be short and not wait on anything.
+ *
+ * ------------------------------------------------------------ */
+void SetFrameDone(WS2812HW * pHW, PFNWS2812FRAMEDONE pfnFrameDone, void * pContext)
+{
+    uint32_t intState = disableInterrupts();
+
+    pHW->pfnFrameDone       = pfnFrameDone;
+    pHW->pFrameDoneContext  = pContext;
+    restoreInterrupts(intState);
+}
+
+/***    uint32_t SetStream(WS2812HW * pHW, uint32_t cbFrame, PFNWS2812FILL pfnFill, void * pContext)
+ *
+ *    Parameters:
+ *          pHW:        The chain, just started with InitWS2812()
+ *
+ *          cbFrame:    The bytes in a refresh, any length
+ *
+ *          pfnFill:    Called to put bytes of the refresh into the ring,
+ *                      from the core timer service and the DMA interrupt
+ *
+ *          pContext:   Passed to pfnFill
+ *
+ *    Return Values:
+ *          True if the chain is now streaming
+ *
+ *    Description:
+ *
+ *      Turns the pattern buffer given to InitWS2812() into a ring of
+ *      two halves, so the pattern memory no longer grows with the chain.
+ *      The pattern DMA channel goes round the ring continuously and 
+ *      interrupts at the end of each half, so the half just read can be
+ *      refilled while the other half is shifted out. A half takes 
+ *      8 SPI clocks a byte to shift out, which is how long pfnFill has.
+ *
+ *      The reset channel is no longer chained, StreamWS2812() starts it
+ *      when the refresh is out.
+ *
+ * ------------------------------------------------------------ */
+uint32_t SetStream(WS2812HW * pHW, uint32_t cbFrame, PFNWS2812FILL pfnFill, void * pContext)
+{
+    uint32_t intState = 0;
+
+    if(!pHW->fInit || pHW->cbHalf == 0 || (pHW->fMode32 && (pHW->cbHalf & 3) != 0) || cbFrame == 0 || pfnFill == NULL || PatternOnWS2812(pHW))
+    {
+        return(0);
+    }
+
+    intState = disableInterrupts();
+    pHW->pfnFill        = pfnFill;
+    pHW->pFillContext   = pContext;
+    pHW->cbFrame        = cbFrame;
+    pHW->cHalves        = (cbFrame + pHW->cbHalf - 1) / pHW->cbHalf;
+    pHW->fStream        = true;
+
+    RingWS2812(pHW);
+
+    // the DMA is stopped on the half of padding after the refresh
+    pHW->tGap           = TicksToShift(pHW, ((pHW->cHalves + 1) * pHW->cbHalf) + CBSPIFIFO);
+    pHW->tStart         = pHW->tLastRun - pHW->tGap;
+    restoreInterrupts(intState);
+
+    return(1);
+}
+
+/***    uint32_t IsFrameBusy(WS2812HW * pHW)
+ *
+ *    Parameters:
+ *          pHW:    The chain
+ *
+ *    Return Values:
+ *          True from EndUpdate() or SwapUpdate() until that update is
+ *          on the chain.
+ *
+ * ------------------------------------------------------------ */
+uint32_t IsFrameBusy(WS2812HW * pHW)
+{
+    return(pHW->fFrameBusy);
+}
+
+/***    uint32_t WaitFrame(WS2812HW * pHW, uint32_t cTicks)
+ *
+ *    Parameters:
+ *          pHW:    The chain
+ *
+ *          cTicks: The most core timer ticks to wait
+ *
+ *    Return Values:
+ *          True if the last update is on the chain, false on a time out
+ *
+ * ------------------------------------------------------------ */
+uint32_t WaitFrame(WS2812HW * pHW, uint32_t cTicks)
+{
+    uint32_t tStart = 0;
+    uint32_t tNow   = 0;
+
+    tStart = TicksWS2812(pHW);
+    while(pHW->fFrameBusy)
+    {
+        tNow = TicksWS2812(pHW);
+        if(tNow - tStart >= cTicks)
+        {
+            return(0);
+        }
+    }
+
+    return(1);
+}
+
+/***    void GetStatsWS2812(WS2812HW * pHW, WS2812STATS * pStats)
+ *
+ *    Parameters:
+ *          pHW:    The chain
+ *
+ *          pStats: Gets the refresh and DMA counters, the rest are left alone
+ *
+ *    Return Values:
+ *          None
+ *
+ *    Description:
+ *
+ *      The counters are kept by the core timer service and the DMA
+ *      interrupt, a handful of adds a refresh. They are copied with
+ *      interrupts off so they all come from the same moment.
+ *
+ * ------------------------------------------------------------ */
+void GetStatsWS2812(WS2812HW * pHW, WS2812STATS * pStats)
+{
+    uint32_t intState = disableInterrupts();
+
+    pStats->cRefreshes  = pHW->cRefreshes;
+    pStats->cLate       = pHW->cLate;
+    pStats->cSkipped    = pHW->cSkipped;
+    pStats->tMaxLate    = pHW->tMaxLate;
+    pStats->tDMABusy    = pHW->tDMABusy;
+    pStats->cUnderruns  = pHW->cUnderruns;
+    restoreInterrupts(intState);
+}
+
+/***    void ClearStatsWS2812(WS2812HW * pHW)
+ *
+ *    Parameters:
+ *          pHW:    The chain
+ *
+ *    Return Values:
+ *          None
+ *
+ * ------------------------------------------------------------ */
+void ClearStatsWS2812(WS2812HW * pHW)
+{
+    uint32_t intState = disableInterrupts();
+
+    pHW->cRefreshes = 0;
+    pHW->cLate      = 0;
+    pHW->cSkipped   = 0;
+    pHW->tMaxLate   = 0;
+    pHW->tDMABusy   = 0;
+    pHW->cUnderruns = 0;
+    restoreInterrupts(intState);
+}
+
+/***    void SetTraceWS2812(WS2812HW * pHW, WS2812TRACE * pTrace)
+ *
+ *    Parameters:
+ *          pHW:    The chain
+ *
+ *          pTrace: The ring to put the refresh and DMA events in, or NULL
+ *
+ *    Return Values:
+ *          None
+ *
+ * ------------------------------------------------------------ */
+void SetTraceWS2812(WS2812HW * pHW, WS2812TRACE * pTrace)
+{
+    uint32_t intState = disableInterrupts();
+
+    pHW->pTrace = pTrace;
+    restoreInterrupts(intState);
+}
@@ -64,9 +64,10 @@
 /*  Fubarino Mini Dout pin 29                                           */
 /*  Any PIC32 with DMA - you need to figure out the Dout pin            */
 /*                                                                      */
-/*  WARNING: currently this code assumes SPI2. Of the chipKIT boards    */
-/*  this works on, the standard Arduino SPI just happens                */
-/*  to always be SPI2, but this is NOT generalized code!                */
+/*  By default this uses SPI2 and DMA channels 0 and 1. Of the chipKIT  */
+/*  boards this works on, the standard Arduino SPI just happens to      */
+/*  be SPI2. begin() can pick another SPI and DMA channel pair, so      */
+/*  several chains can each refresh on their own SPI at the same time.  */
 /*                                                                      */
 /*  The spec says that Dout Vih = .7Vdd and Vdd = 6v-7v However...      */
 /*  it seems to work with Vdd == 4.5v -> 5v and Vih == 3.3              */
@@ -77,25 +78,62 @@
 /*                                                                      */
 /************************************************************************/
 #include <WS2812.h>
+#include <math.h>
 
-extern "C" {
-    uint32_t InitWS2812(uint8_t * pPatternBuffer, uint32_t cbPatternBuffer, uint32_t fInvert);
-    void EndWS2812(void);
-    uint32_t StartUpdate(void);
-    void EndUpdate(void);
-}
+/* The times in WS2812.h, the low times of the measured limits are only
+ * bounded by the bit period. */
+const WS2812Core::TIMING WS2812Core::timingMeasured =
+{
+    { 63,   500     },      // 0 high
+    { 0,    9000    },      // 0 low
+    { 625,  1250    },      // 1 high
+    { 0,    9000    },      // 1 low
+    { 1250, 9000    },      // period
+    9000                    // reset
+};
+
+const WS2812Core::TIMING WS2812Core::timingWS2812 =
+{
+    { 200,  500     },
+    { 650,  950     },
+    { 650,  950     },
+    { 450,  750     },
+    { 650,  1850    },
+    50000
+};
 
-WS2812::WS2812()
+const WS2812Core::TIMING WS2812Core::timingWS2812B =
 {
+    { 200,  500     },
+    { 750,  1050    },
+    { 750,  1050    },
+    { 200,  500     },
+    { 1100, 1400    },
+    50000
+};
+
+WS2812Core::WS2812Core()
+{
+    _pDriver    = &_platformDriver;
+    _usRefresh  = (1000 * TICKSPERREFRESH) / CORE_TICK_RATE;
+    _fPush      = false;
+    _fMode32    = false;
+    _cEarly     = 0;
+    _brightness = 255;
+    _gamma      = 1.0f;
+    memset(_rgCorrection, 255, sizeof(_rgCorrection));
+    _pfnFrameDone       = NULL;
+    _pFrameDoneContext  = NULL;
+    memset(&_trace, 0, sizeof(_trace));
     init();
 }
 
-WS2812::~WS2812()
+WS2812Core::~WS2812Core()
 {
     end();
 }
 
-/***    void WS2812::init(void)
+/***    void WS2812Core::init(void)
  *
  *    Parameters:
  *          None
@@ -108,85 +146,142 @@ WS2812::~WS2812()
  *      Initializes all of the class variables
  *
  * ------------------------------------------------------------ */
-void WS2812::init(void)
+void WS2812Core::init(void)
 {
     _fInit              =   false;
     _fInvert            =   false;
     _cDevices           =   0;
     _pPatternBuffer     =   NULL;
+    _pPatternBufferFront=   NULL;
     _cbPatternBuffer    =   0;
-    _iBit               =   0;
-    _iByte              =   0;
+    _spiClockRate       =   WS2812_SPI_CLOCK_RATE;
     _iNextDevice        =   0;
-    _pGRB               =   NULL;
+    _iFirstDevice       =   0;
+    _iEndDevice         =   0;
+    _tDevice            =   0;
+    _cDirty             =   0;
+    _cUpdate            =   0;
+    _iUpdate            =   0;
+    _cStale             =   0;
+    _pPixels            =   NULL;
+    _fIndexed           =   false;
+    _edit               =   EDITNONE;
+    _cFill              =   0;
+    _cShift             =   0;
+    _cbPixel            =   sizeof(GRB);
+    _pPalette           =   NULL;
+    _cPalette           =   0;
+    _pPaletteSymbols    =   NULL;
     _updateState        =   INIT;
+    _cbDevice           =   0;
+    _pfnEncode          =   NULL;
+    _fStream            =   false;
+    _pStreamPixels      =   NULL;
+    _fStreamIndexed     =   false;
+    _pColorLUT          =   NULL;
+    _pDither            =   NULL;
+    _cFrames            =   0;
+    _cCaught            =   0;
+    _fEarly             =   false;
+    _fCaught            =   false;
+    _tEncodeFrame       =   0;
+    _tEncodeLast        =   0;
+    _tEncodeMax         =   0;
+    _tEncode            =   0;
+    _fRefused           =   false;
 }
 
-/***    bool WS2812::begin(uint32_t cDevices, uint8_t * pPatternBuffer, uint32_t cbPatternBuffer, bool fInvert)
+/***    bool WS2812Core::begin(uint32_t cDevices, uint8_t * pPatternBuffer, uint8_t * pPatternBuffer2, uint32_t cbPatternBuffer, bool fInvert, ...)
  *
  *    Parameters:
- *          cDevices:   The number of devices in the WS2812 string / chain
- *
- *          pPatternBuffer: A pointer to the pattern buffer for the DMA to use
- *                          The application allocates this and should be 
- *                          CBWS2812PATBUF(__cDevices) bytes long.
+ *          As WS2812::begin(), plus
  *
- *          cbPatternBuffer: Size of pPatternBuffer in bytes. This should be 
- *                          CBWS2812PATBUF(__cDevices) or larger
+ *          pfnEncode:      The encoder that converts devices into SPI symbols
+ *                          for the bit timings given.
  *
- *          fInvert:        Because the WS2812 does not have a VinH <= 3.3 when Vcc >= 4.7v
- *                          External hardware may be needed to level shift the 3.3v SDO output
- *                          to a higher Data in signal to the WS2812. This level shifter may
- *                          be a simple transistor tied to 5v - 7v. The transistor will invert
- *                          the SDO output signal and to maintain the correct signal polarity
- *                          to the WS2812 you would need to invert the signal coming out of SDO.
- *                          If fInvert is true, the SDO output signal will be inverted from what
- *                          the WS2812 would normally take. By default, the is "false".
+ *          fStream:        True for WS2812::beginStream(), pPatternBuffer is the 
+ *                          ring and cbPatternBuffer its size.
  *
- *          cBitWidth:      The number of nanoseconds that the width of a single bit (high + low)
- *                          should be.
+ *          cColors:        The colors in a device, the symbols sent for each
  *
- *          cBit1High:      The number of nanoseconds that a "1" bit should be high for. (must be
- *                          less than cBitWidth)
- * 
- *          cBit0High:      The number of nanoseconds that a "0" bit should be high for. (must be
- *                          less than cBitWidth)
+ *          cbPixel:        The size of one of the application's pixels
  *
+ *          spiClockRate:   The SPI clock the bit widths are counted in
  *
  *    Return Values:
- *          True if the WS2812 library was successfully initialized
- *          False if it was not. Probably because the pattern buffer was not the correct size
- *                  or because there were no open slots in the CoreTimer Service Routines.
+ *          As WS2812::begin()
  *
  *    Description:
  *
- *      Initializes the WS2812 library and starts streaming a refresh cycle out on SDO
+ *      Common initialization for WS2812 and WS2812T
  *
  * ------------------------------------------------------------ */
-bool WS2812::begin(
+bool WS2812Core::begin(
     uint32_t cDevices, 
     uint8_t * pPatternBuffer, 
+    uint8_t * pPatternBuffer2, 
     uint32_t cbPatternBuffer, 
     bool fInvert,
     uint16_t cBitWidth, 
     uint16_t cBit1High, 
-    uint16_t cBit0High)
+    uint16_t cBit0High,
+    uint8_t iSPI,
+    uint8_t iDMA,
+    PFNENCODE pfnEncode,
+    bool fStream,
+    uint32_t cColors,
+    uint32_t cbPixel,
+    uint32_t spiClockRate)
 {
+    uint32_t cbNeeded;
+
     if(_fInit)
     {
         return(true);
     }
 
-    if(cDevices == 0 || pPatternBuffer == NULL || cbPatternBuffer < CBWS2812PATBUF(cDevices))
+    // a symbol must fit in the pattern buffer and have a low period, and a 1 a longer high than a 0
+    if(cBitWidth == 0 || cBitWidth > WS2812_MAX_SPI_CLOCKS_PER_LED_BIT || cBit1High >= cBitWidth || cBit0High >= cBitWidth ||
+       cBit0High == 0 || cBit1High <= cBit0High)
+    {
+        return(false);
+    }
+
+    // narrower symbols need less than CBWS2812PATBUF(), see CBWS2812PATBUFCLKS()
+    cbNeeded = cColors * cBitWidth * (fStream ? 2 : cDevices);
+
+    if(cDevices == 0 || pPatternBuffer == NULL || cColors == 0 || cColors > 4 || cbPixel < cColors || cbPatternBuffer < cbNeeded)
+    {
+        return(false);
+    }
+
+    // the encoders store whole words into a pattern buffer on a word boundary, move up to one if there is room
+    if(((uintptr_t) pPatternBuffer & 3) != 0 || ((uintptr_t) pPatternBuffer2 & 3) != 0)
+    {
+        uint32_t cbAlign1   = (4 - ((uintptr_t) pPatternBuffer & 3)) & 3;
+        uint32_t cbAlign2   = (4 - ((uintptr_t) pPatternBuffer2 & 3)) & 3;
+        uint32_t cbAlign    = (cbAlign1 > cbAlign2) ? cbAlign1 : cbAlign2;
+
+        if(cbPatternBuffer - cbAlign >= cbNeeded)
+        {
+            pPatternBuffer      += cbAlign1;
+            pPatternBuffer2     += (pPatternBuffer2 != NULL) ? cbAlign2 : 0;
+            cbPatternBuffer     -= cbAlign;
+        }
+    }
+
+    // in word order a device must be whole words on a word boundary, so copying and moving devices keeps the order
+    if(_fMode32 && (((cColors * cBitWidth) & 3) != 0 || ((uintptr_t) pPatternBuffer & 3) != 0 || ((uintptr_t) pPatternBuffer2 & 3) != 0))
     {
         return(false);
     }
 
     init();
     _cDevices           =   cDevices;
-     _pPatternBuffer    =   pPatternBuffer;
+    _pPatternBuffer     =   pPatternBuffer;
+    _pPatternBufferFront=   pPatternBuffer2;
     _cbPatternBuffer    =   cbPatternBuffer;
-    _fInit              =   InitWS2812(pPatternBuffer, cbPatternBuffer, fInvert);
+    _spiClockRate       =   spiClockRate;
     _fInvert            =   fInvert;
 
     /* All three of the below values are defaulted to values that will work well with many CPU clocks speeds
@@ -199,278 +294,2481 @@ bool WS2812::begin(
     /* This is the number of SPI clocks that represent the high portion of a 0 symbol. */
     _iBit0SPIClocksHigh = cBit0High;
 
+    /* Each color bit is _iBitSPIClocks SPI bits, so each color byte is _iBitSPIClocks bytes */
+    _cbDevice = cColors * _iBitSPIClocks;
+    _cbPixel = cbPixel;
+    _pfnEncode = pfnEncode;
+
+    /* The halves of the ring hold whole devices, so a refill is whole devices too */
+    if(fStream)
+    {
+        _fStream            = true;
+        _cbPatternBuffer    = 2 * (((cbPatternBuffer / 2) / _cbDevice) * _cbDevice);
+    }
+
+    /* In MODE32 the DMA moves whole words */
+    else if(_fMode32)
+    {
+        _cbPatternBuffer   &= ~3;
+    }
+
+    /* The encoder writes every byte of a device, so the pattern buffer is only cleared
+     * once here. Whatever is past the last device is the start of the reset period. */
+    memset(_pPatternBuffer, (_fInvert ? 0xFF : 0), _cbPatternBuffer);
+    if(_pPatternBufferFront != NULL)
+    {
+        memset(_pPatternBufferFront, (_fInvert ? 0xFF : 0), _cbPatternBuffer);
+    }
+
+    /* Nothing is converted yet, so the first update has to do every device */
+    markDirty(0, _cDevices);
+    if(_pPatternBufferFront != NULL)
+    {
+        _rgStale[0].iFirst  = 0;
+        _rgStale[0].iEnd    = _cDevices;
+        _cStale             = 1;
+    }
+
+    _fInit              =   _pDriver->init(iSPI, iDMA, _pPatternBuffer, _cbPatternBuffer, fInvert, _spiClockRate, _fMode32);
+
+    if(_fInit && _fStream)
+    {
+        _fInit          =   _pDriver->setStream(_cDevices * _cbDevice, fillStream, this);
+    }
+
     if(!_fInit)
     {
         end();
     }
+    else
+    {
+        updateRefresh();
+        _pDriver->setFrameDone(frameDone, this);
+        if(_trace.pEvents != NULL)
+        {
+            _pDriver->setTrace(&_trace);
+        }
+    }
 
     return(_fInit);
 }
 
-/***    void WS2812::end(void)
+/***    bool WS2812::begin(uint32_t cDevices, uint8_t * pPatternBuffer, uint8_t * pPatternBuffer2, uint32_t cbPatternBuffer, bool fInvert, ...)
  *
  *    Parameters:
- *          None
+ *          cDevices:   The number of devices in the WS2812 string / chain
+ *
+ *          pPatternBuffer: A pointer to the pattern buffer for the DMA to use
+ *                          The application allocates this and should be 
+ *                          CBWS2812PATBUF(__cDevices) bytes long.
+ *
+ *          pPatternBuffer2: A second pattern buffer the same size as pPatternBuffer, or NULL.
+ *                          With two pattern buffers, updateLEDs() converts into one while
+ *                          the DMA keeps refreshing the chain from the other, and the two
+ *                          are swapped at the next refresh after the update completes.
+ *                          updateLEDs() then only waits if the previous update has not
+ *                          been swapped in yet. The begin() without pPatternBuffer2
+ *                          uses a single pattern buffer.
+ *
+ *          cbPatternBuffer: Size of each pattern buffer in bytes. This should be 
+ *                          CBWS2812PATBUF(__cDevices) or larger
+ *
+ *          fInvert:        Because the WS2812 does not have a VinH <= 3.3 when Vcc >= 4.7v
+ *                          External hardware may be needed to level shift the 3.3v SDO output
+ *                          to a higher Data in signal to the WS2812. This level shifter may
+ *                          be a simple transistor tied to 5v - 7v. The transistor will invert
+ *                          the SDO output signal and to maintain the correct signal polarity
+ *                          to the WS2812 you would need to invert the signal coming out of SDO.
+ *                          If fInvert is true, the SDO output signal will be inverted from what
+ *                          the WS2812 would normally take. By default, the is "false".
+ *
+ *          cBitWidth:      The number of WS2812_SPI_CLOCK_RATE SPI clocks that the width of 
+ *                          a single bit (high + low) should be.
+ *
+ *          cBit1High:      The number of SPI clocks that a "1" bit should be high for. (must be
+ *                          less than cBitWidth)
+ * 
+ *          cBit0High:      The number of SPI clocks that a "0" bit should be high for. (must be
+ *                          less than cBitWidth)
+ *
+ *          iSPI:           Which SPI the chain is on, WS2812_DEFAULT_SPI is SPI2. Map its
+ *                          SDO to the Dout pin in the sketch.
+ *
+ *          iDMA:           DMA channels iDMA and iDMA + 1 are used, WS2812_DEFAULT_DMA
+ *                          is 0. Each WS2812 object needs its own SPI and DMA channels.
  *
  *    Return Values:
- *          None
+ *          True if the WS2812 library was successfully initialized
+ *          False if it was not. Probably because the pattern buffer was not the correct size,
+ *                  the bit timings do not fit in WS2812_MAX_SPI_CLOCKS_PER_LED_BIT,
+ *                  a 0 has no high time or a 1 no longer one than a 0,
+ *                  the SPI or DMA channels do not exist or are used by another WS2812,
+ *                  or because there were no open slots in the CoreTimer Service Routines.
  *
  *    Description:
  *
- *      Terminates the WS2812 library and releases the DMA and SPI peripherals.
+ *      Initializes the WS2812 library and starts streaming a refresh cycle out on SDO
  *
  * ------------------------------------------------------------ */
-void WS2812::end(void)
+bool WS2812::begin(
+    uint32_t cDevices, 
+    uint8_t * pPatternBuffer, 
+    uint8_t * pPatternBuffer2, 
+    uint32_t cbPatternBuffer, 
+    bool fInvert,
+    uint16_t cBitWidth, 
+    uint16_t cBit1High, 
+    uint16_t cBit0High,
+    uint8_t iSPI,
+    uint8_t iDMA)
 {
-    EndWS2812();
-    init();
+    return(start(cDevices, pPatternBuffer, pPatternBuffer2, cbPatternBuffer, fInvert, cBitWidth, cBit1High, cBit0High, iSPI, iDMA, false));
 }
 
-/***    void  WS2812::abortUpdate(void)
+/***    bool WS2812::beginStream(uint32_t cDevices, uint8_t * pRing, uint32_t cbRing, bool fInvert, ...)
  *
  *    Parameters:
- *          None
+ *          cDevices:   The number of devices in the WS2812 string / chain
+ *
+ *          pRing:      The pattern memory the DMA streams through, 
+ *                      CBWS2812RING(__cDevicesPerHalf) bytes, whatever the
+ *                      length of the chain.
+ *
+ *          cbRing:     The size of pRing in bytes, at least CBWS2812RING(1)
+ *
+ *          The rest:   As begin()
  *
  *    Return Values:
- *          None
+ *          As begin()
  *
  *    Description:
  *
- *      Terminates updating the pattern buffer to a new
- *      data stream to the WS2812. Because the pattern
- *      buffer is most likely in an unfinished state
- *      the WS2812 will have no valid pattern buffer to
- *      refresh the chain; so the DMA will be left in
- *      the reset cycle. Since the pattern isn't 
- *      being refreshed, the WS2812 may 
- *      incur noise on the chain and start displaying
- *      unexpected results. updateLEDs() should be called
- *      with a new pattern to re-engage the pattern buffer
- *      on a regular refresh cycle.
+ *      Like begin(), but instead of a pattern buffer for the whole chain
+ *      each refresh is converted as it goes out, half of pRing at a time, 
+ *      by the DMA interrupt. Pattern memory no longer grows with the chain, 
+ *      the chain length is only limited by the GRB array.
+ *
+ *      updateLEDs() does not convert anything, it hands rgGRB over to be
+ *      streamed from and returns true once that is committed. Every
+ *      refresh after that reads rgGRB again, so rgGRB must stay valid, and
+ *      changes to it show at the next refresh, or part way through one
+ *      that is going out; isBusy() is false once the update is on the chain.
+ *
  * ------------------------------------------------------------ */
-void  WS2812::abortUpdate(void)
+bool WS2812::beginStream(
+    uint32_t cDevices, 
+    uint8_t * pRing, 
+    uint32_t cbRing, 
+    bool fInvert,
+    uint16_t cBitWidth, 
+    uint16_t cBit1High, 
+    uint16_t cBit0High,
+    uint8_t iSPI,
+    uint8_t iDMA)
 {
-        _pGRB           = NULL;
-        _iNextDevice    = 0;
-        _iBit           = 0;
-        _iByte          = 0;
-        _updateState    = INIT;
+    return(start(cDevices, pRing, NULL, cbRing, fInvert, cBitWidth, cBit1High, cBit0High, iSPI, iDMA, true));
 }
 
-/***    bool WS2812::updateLEDs(GRB rgGRB[], uint32_t cPass)
+/***    bool WS2812::begin(uint32_t cDevices, uint8_t * pPatternBuffer, uint8_t * pPatternBuffer2, uint32_t cbPatternBuffer, const TIMING& timing, ...)
  *
  *    Parameters:
- *          rgGRB:  An array of GRB structures that contains the 
- *                  the value for each Green, Red, or Blue pixel in
- *                  the device. Values may be from 0 to 255.
- *                  This point must NOT change until updateLEDs() returns true.
+ *          timing:     The LED timings in nS, WS2812::timingWS2812B, WS2812::timingWS2812,
+ *                      WS2812::timingMeasured or your own.
  *
- *          cPass:  How many devices to convert in the pattern buffer per call to
- *                  updateLEDs(). This allows you to control how long you say in updateLEDs()
- *                  The default value is to convert 5 devices per call to updateLEDs().
+ *          The rest:   As the begin() with the bit timings in SPI clocks
  *
  *    Return Values:
- *          False while updateLEDs() is still working to convert devices.
- *          True when all devices have been converted.
+ *          As that begin(), also false if no SPI clock and symbols meet timing
  *
  *    Description:
  *
- *      This will return false until the DMA is stream the refresh cycle
- *      and until all devices have been converted into the pattern buffer.
- *      Once everything is done, this will return true and then you can change
- *      rgGRB to a new pattern. You need to repeatedly call updateLEDs() until it 
- *      returns true.
+ *      Instead of the SPI clocks of a bit at WS2812_SPI_CLOCK_RATE, the
+ *      SPI clock and symbols are picked by pickTiming() for the peripheral
+ *      bus clock the board runs at. For a WS2812B that is 3 clock symbols
+ *      at about 2.4MHz, 9 bytes a device instead of 12, so the pattern 
+ *      buffer can be CBWS2812PATBUFCLKS(__cDevices, 3); spiClockRate() 
+ *      tells what was picked.
  *
  * ------------------------------------------------------------ */
-bool WS2812::updateLEDs(GRB rgGRB[], uint32_t cPass)
+bool WS2812::begin(
+    uint32_t cDevices, 
+    uint8_t * pPatternBuffer, 
+    uint8_t * pPatternBuffer2, 
+    uint32_t cbPatternBuffer, 
+    const TIMING& timing,
+    bool fInvert,
+    uint8_t iSPI,
+    uint8_t iDMA)
 {
-    if(!_fInit)
+    SPITIMING spiTiming;
+
+    if(!pickTiming(timing, driver()->pbClock(), &spiTiming))
     {
         return(false);
     }
 
-    switch(_updateState)
+    return(start(cDevices, pPatternBuffer, pPatternBuffer2, cbPatternBuffer, fInvert, spiTiming.cBitWidth, spiTiming.cBit1High, spiTiming.cBit0High, iSPI, iDMA, false, spiTiming.spiClockRate));
+}
+
+/***    bool WS2812::beginStream(uint32_t cDevices, uint8_t * pRing, uint32_t cbRing, const TIMING& timing, ...)
+ *
+ *    Parameters:
+ *          As beginStream() and the begin() with a TIMING
+ *
+ *    Return Values:
+ *          As beginStream()
+ *
+ *    Description:
+ *
+ *      beginStream() with the SPI clock and symbols picked for timing
+ *
+ * ------------------------------------------------------------ */
+bool WS2812::beginStream(
+    uint32_t cDevices, 
+    uint8_t * pRing, 
+    uint32_t cbRing, 
+    const TIMING& timing,
+    bool fInvert,
+    uint8_t iSPI,
+    uint8_t iDMA)
+{
+    SPITIMING spiTiming;
+
+    if(!pickTiming(timing, driver()->pbClock(), &spiTiming))
     {
-        case INIT:
-            if(_pGRB == NULL)
+        return(false);
+    }
+
+    return(start(cDevices, pRing, NULL, cbRing, fInvert, spiTiming.cBitWidth, spiTiming.cBit1High, spiTiming.cBit0High, iSPI, iDMA, true, spiTiming.spiClockRate));
+}
+
+/***    bool WS2812Core::pickTiming(const TIMING& timing, uint32_t pbClock, SPITIMING * pSPITiming)
+ *
+ *    Parameters:
+ *          timing:     The LED timings in nS
+ *
+ *          pbClock:    The peripheral bus clock the SPI clock is divided from
+ *
+ *          pSPITiming: Gets the SPI clock and the symbols in SPI clocks
+ *
+ *    Return Values:
+ *          True if an SPI clock and symbols meet every time in timing
+ *
+ *    Description:
+ *
+ *      The SPI clock is pbClock / 2 / a whole number. The narrowest symbols
+ *      use the least pattern buffer and DMA, so the widths are tried from 
+ *      3 SPI clocks up to WS2812_MAX_SPI_CLOCKS_PER_LED_BIT, and the first 
+ *      width anything fits is taken. Of the clocks and high times that fit
+ *      that width, the one that is furthest inside its closest limit wins,
+ *      it leaves the most room for the LEDs to be off their data sheet.
+ *
+ * ------------------------------------------------------------ */
+bool WS2812Core::pickTiming(const TIMING& timing, uint32_t pbClock, SPITIMING * pSPITiming)
+{
+    uint32_t    cBitWidth;
+    uint32_t    iDiv;
+    uint32_t    cHigh0;
+    uint32_t    cHigh1;
+    int32_t     nsBest      = -1;
+
+    // a 0 high, a longer 1 high and a low after it take 3 clocks at least
+    for(cBitWidth = 3; cBitWidth <= WS2812_MAX_SPI_CLOCKS_PER_LED_BIT && nsBest < 0; cBitWidth++)
+    {
+        for(iDiv = 1; 2 * iDiv <= WS2812_MAX_SPI_DIVIDER; iDiv++)
+        {
+            // nS of an SPI clock, kept in 1/pbClock units until the end so nothing rounds
+            uint64_t    clock       = 2ull * iDiv * 1000000000ull;
+            uint32_t    nsPeriod    = (uint32_t) ((cBitWidth * clock) / pbClock);
+
+            if(nsPeriod < timing.period.nsMin)
             {
-                _pGRB           = rgGRB;
-                _iNextDevice    = 0;
-                _iBit           = 0;
-                _iByte          = 0;
-                memset(_pPatternBuffer, 0, _cbPatternBuffer);
-                _updateState = WAITUPD;
+                continue;
             }
-            break;
-
-        case WAITUPD:
-            if(StartUpdate())
+            else if(nsPeriod > timing.period.nsMax)
             {
-                _updateState = CONVGRB;
+                break;
             }
-            break;
 
-        case CONVGRB:
-            if(_pGRB == rgGRB)
+            for(cHigh0 = 1; cHigh0 < cBitWidth; cHigh0++)
             {
-
-                for(int i=0; i<cPass && _iNextDevice < _cDevices; i++, _iNextDevice++)
+                for(cHigh1 = cHigh0 + 1; cHigh1 < cBitWidth; cHigh1++)
                 {
-                    applyGRB(rgGRB[_iNextDevice]);
-                }
+                    uint32_t    rgns[5];
+                    const RANGE * rgRange[5] = { &timing.t0High, &timing.t0Low, &timing.t1High, &timing.t1Low, &timing.period };
+                    int32_t     nsMargin    = 0x7FFFFFFF;
+                    uint32_t    i;
 
-                if(_iNextDevice == _cDevices)
-                {
-                    if(_fInvert)
+                    rgns[0] = (uint32_t) ((cHigh0 * clock) / pbClock);
+                    rgns[1] = (uint32_t) (((cBitWidth - cHigh0) * clock) / pbClock);
+                    rgns[2] = (uint32_t) ((cHigh1 * clock) / pbClock);
+                    rgns[3] = (uint32_t) (((cBitWidth - cHigh1) * clock) / pbClock);
+                    rgns[4] = nsPeriod;
+
+                    // the margin is how far the time closest to its limit is inside it
+                    for(i = 0; i < 5; i++)
                     {
-                        _updateState = INVERT;
+                        int32_t nsLow   = (int32_t) (rgns[i] - rgRange[i]->nsMin);
+                        int32_t nsHigh  = (int32_t) (rgRange[i]->nsMax - rgns[i]);
+
+                        nsMargin = (nsLow < nsMargin) ? nsLow : nsMargin;
+                        nsMargin = (nsHigh < nsMargin) ? nsHigh : nsMargin;
                     }
-                    else
+
+                    if(nsMargin > nsBest)
                     {
-                        _updateState = ENDUPD;
+                        nsBest                      = nsMargin;
+                        pSPITiming->spiClockRate    = pbClock / (2 * iDiv);
+                        pSPITiming->cBitWidth       = cBitWidth;
+                        pSPITiming->cBit1High       = cHigh1;
+                        pSPITiming->cBit0High       = cHigh0;
                     }
                 }
             }
-            break;
+        }
+    }
 
-        case INVERT:
-            for(int i=0; i<_cbPatternBuffer; i++)
-            {
-                _pPatternBuffer[i] = ~_pPatternBuffer[i];
-            }
-            _updateState = ENDUPD;
-            break;
+    return(nsBest >= 0);
+}
 
-        case ENDUPD:
-            abortUpdate();
-            EndUpdate();
-            return(true);
-            break;
+/***    bool WS2812::start(uint32_t cDevices, uint8_t * pPatternBuffer, uint8_t * pPatternBuffer2, uint32_t cbPatternBuffer, bool fInvert, ..., bool fStream)
+ *
+ *    Parameters:
+ *          As begin(), plus
+ *
+ *          fStream:    True for beginStream()
+ *
+ *          spiClockRate: The SPI clock the bit timings are in
+ *
+ *    Return Values:
+ *          As begin()
+ *
+ *    Description:
+ *
+ *      Picks the encoder for the bit timings and starts the chain
+ *
+ * ------------------------------------------------------------ */
+bool WS2812::start(
+    uint32_t cDevices, 
+    uint8_t * pPatternBuffer, 
+    uint8_t * pPatternBuffer2, 
+    uint32_t cbPatternBuffer, 
+    bool fInvert,
+    uint16_t cBitWidth, 
+    uint16_t cBit1High, 
+    uint16_t cBit0High,
+    uint8_t iSPI,
+    uint8_t iDMA,
+    bool fStream,
+    uint32_t spiClockRate)
+{
+    PFNENCODE pfnEncode = encodeSymbols;
 
-        default:
-            break;
+    // the default timings have a compile time symbol table, no need to build one
+    if( cBitWidth == WS2812_DEFAULT_BIT_WIDTH_CLKS      && 
+        cBit1High == WS2812_DEFAULT_BIT_1_HIGH_CLKS     && 
+        cBit0High == WS2812_DEFAULT_BIT_0_HIGH_CLKS)
+    {
+        pfnEncode = WS2812Encoder<>::encode;
     }
 
-    return(false);
+    if(!WS2812Core::begin(cDevices, pPatternBuffer, pPatternBuffer2, cbPatternBuffer, fInvert, cBitWidth, cBit1High, cBit0High, iSPI, iDMA, pfnEncode, fStream, 3, sizeof(GRB), spiClockRate))
+    {
+        return(false);
+    }
+
+    if(pfnEncode == encodeSymbols)
+    {
+        buildSymbols();
+    }
+
+    return(true);
 }
 
-/***    void WS2812::applyGRB(GRB& grb)
+/***    void WS2812Core::end(void)
  *
  *    Parameters:
- *          grb:    a single device Green, Red, Blue element to be converted
+ *          None
  *
  *    Return Values:
  *          None
  *
  *    Description:
  *
- *      A private method to convert 1 device into the pattern buffer
+ *      Terminates the WS2812 library and releases the DMA and SPI peripherals.
  *
  * ------------------------------------------------------------ */
-void __attribute__((always_inline)) WS2812::applyGRB(GRB& grb)
+void WS2812Core::end(void)
 {
-    applyColor(grb.green);
-    applyColor(grb.red);
-    applyColor(grb.blue);
+    _pDriver->end();
+    init();
 }
 
-/***    void WS2812::applyColor(uint8_t color)
+/***    bool WS2812Core::setDriver(WS2812Driver * pDriver)
  *
  *    Parameters:
- *          color:    a value between 0 - 255, it is the 
- *                    intensity of a single color
+ *          pDriver:    The driver that streams the pattern buffer to the chain,
+ *                      or NULL for the board's own SPI and DMA driver.
  *
  *    Return Values:
- *          None
+ *          True if the driver was set, false if begin() has already been called.
  *
  *    Description:
  *
- *      A private method to convert 1 color into the pattern buffer
+ *      Swaps out the hardware under the update state machine, for instance
+ *      for a WS2812HostDriver to run the encoder without any LEDs.
+ *      Must be called before begin().
  *
  * ------------------------------------------------------------ */
-void WS2812::applyColor(uint8_t color)
+bool WS2812Core::setDriver(WS2812Driver * pDriver)
 {
-    int i = 0;
-
-    for(i=7; i>=0; i--)
+    if(_fInit)
     {
-        applyBit(((color & (1 << i)) != 0));
+        return(false);
     }
+
+    _pDriver = (pDriver != NULL) ? pDriver : &_platformDriver;
+    return(true);
 }
 
-/***    void WS2812::applyBit(uint32_t fOne)
+/***    bool WS2812Core::setRefreshPeriod(uint32_t usRefresh)
  *
  *    Parameters:
- *          fOne:   True if a one is to be applied to the pattern buffer
- *                  False if a zero is to be applied to the pattern buffer
+ *          usRefresh:  How often the pattern buffer is sent out, in uS
  *
  *    Return Values:
- *          None
+ *          True if the period was set, false if usRefresh is 0
  *
  *    Description:
  *
- *      A private method to convert 1 or 0 into the pattern buffer
+ *      The chain is refreshed every usRefresh even if nothing changed,
+ *      to put right anything noise on the data line may have done.
+ *      The default is 30mS. A refresh never starts until the last one
+ *      is out, so a period shorter than a refresh takes just sends
+ *      back to back. May be called before or after begin().
  *
  * ------------------------------------------------------------ */
-void __attribute__((always_inline)) WS2812::applyBit(uint32_t fOne)
+bool WS2812Core::setRefreshPeriod(uint32_t usRefresh)
 {
-    int i = 0;
-
-    // apply a one to the pattern buffer
-    if(fOne)
+    if(usRefresh == 0)
     {
-        i = 0;
-        
-        // See WS2812.h for explanation on these bit timings
-        // This while loops inserts '1's into the bitstream for as many SPI
-        // clocks as we need in order to represent the 'high' part of a '1' symbol
-        while(i < _iBit1SPIClocksHigh)
-        {
-            for(; _iBit < 8 && i < _iBit1SPIClocksHigh; _iBit++, i++)
-            {
-                _pPatternBuffer[_iByte] |= ((uint8_t)(1 << (7-_iBit)));
-            }
+        return(false);
+    }
 
-            if(_iBit == 8)
-            {
-                _iBit = 0;
-                _iByte++;
-            }
-        }
+    _usRefresh = usRefresh;
+    if(_fInit)
+    {
+        updateRefresh();
+    }
 
-        // since the buffer is init with zeros
-        // just skip forward to fill out the rest of the symbol with zeros.
-        _iBit   += _iBitSPIClocks - _iBit1SPIClocksHigh;
-        _iByte  += _iBit / 8;
-        _iBit   %= 8;
-     }
+    return(true);
+}
+
+/***    void WS2812Core::setPushOnCommit(bool fPush)
+ *
+ *    Parameters:
+ *          fPush:  True to send an update as soon as it is done
+ *
+ *    Return Values:
+ *          None
+ *
+ *    Description:
+ *
+ *      Normally a finished update waits for the next refresh, up to
+ *      the refresh period. With fPush, an update is sent as soon as
+ *      updateLEDs() returns true and the chain has had its reset time 
+ *      after the last refresh, so short chains can run at hundreds
+ *      of frames a second. May be called before or after begin().
+ *
+ * ------------------------------------------------------------ */
+void WS2812Core::setPushOnCommit(bool fPush)
+{
+    _fPush = fPush;
+    if(_fInit)
+    {
+        updateRefresh();
+    }
+}
+
+/***    void WS2812Core::setEarlyStart(uint32_t cLead)
+ *
+ *    Parameters:
+ *          cLead:  How many devices ahead of the DMA an update is kept,
+ *                  0 to hold the refresh until the update is converted
+ *
+ *    Return Values:
+ *          None
+ *
+ *    Description:
+ *
+ *      Normally an update holds the refresh until every device is
+ *      converted, so it shows after the time to convert it plus the
+ *      time to send it. With cLead, once the first cLead devices are
+ *      converted the refresh is let go at once, and the rest are
+ *      converted while the DMA sends the start of the chain. Each call
+ *      to updateLEDs() then converts at least enough devices to be
+ *      cLead ahead of the DMA again, whatever cPass is. An update that
+ *      is spread over many passes of loop() then shows about as soon
+ *      as the chain can be sent. The refresh of an update that starts
+ *      early is pushed, as with setPushOnCommit(true); fills, scrolls
+ *      and other updates keep the refresh timing they had.
+ *
+ *      updateLEDs() must be called again well inside the time the DMA
+ *      takes to send cLead devices. If the DMA catches up, the devices
+ *      past that point go out from the last update; the refreshes after
+ *      are whole again, and getStats() counts it in cCaught. Only single
+ *      buffered updates of pixels or indexes start early; double buffering
+ *      and streaming already send while converting. May be called before
+ *      or after begin().
+ *
+ * ------------------------------------------------------------ */
+void WS2812Core::setEarlyStart(uint32_t cLead)
+{
+    _cEarly = cLead;
+}
+
+/***    void WS2812Core::updateRefresh(void)
+ *
+ *    Parameters:
+ *          None
+ *
+ *    Return Values:
+ *          None
+ *
+ *    Description:
+ *
+ *      Gives the driver the refresh period and if updates are pushed;
+ *      an update that has started early is pushed while it converts,
+ *      or the refresh would not start any sooner.
+ *
+ * ------------------------------------------------------------ */
+void WS2812Core::updateRefresh(void)
+{
+    _pDriver->setRefresh(_usRefresh * (CORE_TICK_RATE / 1000), _fPush || _fEarly);
+}
+
+/***    bool WS2812Core::setMode32(bool fMode32)
+ *
+ *    Parameters:
+ *          fMode32:    True to send the pattern buffer a word at a time
+ *
+ *    Return Values:
+ *          True if set, false if already begun
+ *
+ *    Description:
+ *
+ *      Normally the SPI shifts bytes and the pattern DMA channel moves
+ *      one byte per transfer, 12 DMA transfers per device. In MODE32 
+ *      the SPI shifts 32 bit words and the DMA moves a word per transfer,
+ *      a quarter of the bus transactions. The SPI sends a word MSb first,
+ *      so the encoders write the pattern buffer with the bytes of each 
+ *      word reversed. A device must then be whole words and the pattern
+ *      buffers, ring and palette symbols must be WS2812_ALIGNED: begin()
+ *      fails for 3 color devices of 3 SPI clock symbols. Kept over begin() 
+ *      and end(), call before begin().
+ *
+ * ------------------------------------------------------------ */
+bool WS2812Core::setMode32(bool fMode32)
+{
+    if(_fInit)
+    {
+        return(false);
+    }
+
+    _fMode32 = fMode32;
+    return(true);
+}
+
+/***    bool WS2812Core::setColorTables(uint8_t * pTables, uint32_t cbTables)
+ *
+ *    Parameters:
+ *          pTables:    CBWS2812COLORLUT(pixel) bytes for the color tables,
+ *                      or NULL to stop using them
+ *
+ *          cbTables:   The size of pTables
+ *
+ *    Return Values:
+ *          True if the tables are in use, false if not begun or too small
+ *
+ *    Description:
+ *
+ *      Brightness, color correction and gamma are applied while the 
+ *      encoder converts each color, with one lookup per color in a 256 
+ *      byte table for each byte of the pixel. The tables are worked out
+ *      here and by setBrightness(), setColorCorrection() and setGamma(), 
+ *      so rgGRB is never changed and there is no extra pass over it.
+ *      Without tables the encoder skips the lookup. Call after begin().
+ *
+ * ------------------------------------------------------------ */
+bool WS2812Core::setColorTables(uint8_t * pTables, uint32_t cbTables)
+{
+    if(pTables != NULL && (!_fInit || cbTables < 256 * _cbPixel))
+    {
+        return(false);
+    }
+
+    _pColorLUT = pTables;
+
+    // buildColorTables() converts the palette and marks the devices dirty, without the tables do it here
+    if(_pColorLUT != NULL)
+    {
+        buildColorTables();
+    }
+    else
+    {
+        expandPalette();
+        markDirty(0, _cDevices);
+    }
+
+    return(_pColorLUT != NULL);
+}
+
+/***    void WS2812Core::setBrightness(uint8_t brightness)
+ *
+ *    Parameters:
+ *          brightness: 255 for full brightness, down to 0 for off
+ *
+ *    Return Values:
+ *          None
+ *
+ *    Description:
+ *
+ *      Scales every color, after gamma. Needs setColorTables(), may be
+ *      called before or after begin(). The next update converts every
+ *      device, updateDirtyLEDs() included.
+ *
+ * ------------------------------------------------------------ */
+void WS2812Core::setBrightness(uint8_t brightness)
+{
+    _brightness = brightness;
+    buildColorTables();
+}
+
+/***    void WS2812Core::setColorCorrection(const uint8_t rgCorrection[], uint32_t cCorrection)
+ *
+ *    Parameters:
+ *          rgCorrection:   A scale for each byte of the pixel, in the order
+ *                          the pixel has them, 255 leaves a color alone.
+ *                          {255, 176, 240} on a GRB pixel takes red and blue 
+ *                          down a little.
+ *
+ *          cCorrection:    How many scales, bytes past them are not scaled
+ *
+ *    Return Values:
+ *          None
+ *
+ *    Description:
+ *
+ *      Per color correction, applied with the brightness. Needs 
+ *      setColorTables(), may be called before or after begin().
+ *
+ * ------------------------------------------------------------ */
+void WS2812Core::setColorCorrection(const uint8_t rgCorrection[], uint32_t cCorrection)
+{
+    for(uint32_t i = 0; i < sizeof(_rgCorrection); i++)
+    {
+        _rgCorrection[i] = (i < cCorrection) ? rgCorrection[i] : 255;
+    }
+
+    buildColorTables();
+}
+
+/***    void WS2812Core::setGamma(float gamma)
+ *
+ *    Parameters:
+ *          gamma:  The gamma curve, 2.2 or so to make fades look even,
+ *                  1.0 for none, the default
+ *
+ *    Return Values:
+ *          None
+ *
+ *    Description:
+ *
+ *      Each color value is sent as 255 * (value / 255) ^ gamma. The 
+ *      curve is only worked out here, never while encoding. Needs 
+ *      setColorTables(), may be called before or after begin().
+ *
+ * ------------------------------------------------------------ */
+void WS2812Core::setGamma(float gamma)
+{
+    _gamma = (gamma > 0) ? gamma : 1.0f;
+    buildColorTables();
+}
+
+/***    void WS2812Core::buildColorTables(void)
+ *
+ *    Parameters:
+ *          None
+ *
+ *    Return Values:
+ *          None
+ *
+ *    Description:
+ *
+ *      Works out what each value of each pixel byte is sent as, 
+ *      gamma first so brightness and correction scale the light 
+ *      rather than the value. Every device is marked dirty, as 
+ *      the pattern buffer no longer matches the tables.
+ *
+ * ------------------------------------------------------------ */
+void WS2812Core::buildColorTables(void)
+{
+    if(_pColorLUT == NULL)
+    {
+        return;
+    }
+
+    for(uint32_t value = 0; value < 256; value++)
+    {
+        uint32_t level = value;
+
+        if(_gamma != 1.0f)
+        {
+            level = (uint32_t) ((255.0f * powf(value / 255.0f, _gamma)) + 0.5f);
+        }
+
+        for(uint32_t iByte = 0; iByte < _cbPixel; iByte++)
+        {
+            uint32_t scale = _brightness * ((iByte < sizeof(_rgCorrection)) ? _rgCorrection[iByte] : 255);
+
+            _pColorLUT[(iByte << 8) + value] = (uint8_t) (((level * scale) + ((255 * 255) / 2)) / (255 * 255));
+        }
+    }
+
+    expandPalette();
+    markDirty(0, _cDevices);
+}
+
+/***    bool WS2812Core::setDither(uint8_t * pError, uint32_t cbError)
+ *
+ *    Parameters:
+ *          pError:     CBWS2812DITHER(cDevices, format) bytes for the dither 
+ *                      state, or NULL to stop dithering
+ *
+ *          cbError:    The size of pError
+ *
+ *    Return Values:
+ *          True if dithering, false if not begun with beginStream() or
+ *          too small
+ *
+ *    Description:
+ *
+ *      With a 16 bit pixel format (WS2812FormatGRB16, WS2812FormatGRBW16)
+ *      each color is sent as its high byte. pError keeps, for each color of 
+ *      each device, the part of the low byte not yet sent; every time a 
+ *      device is converted it is added in, and what carries into the high 
+ *      byte goes out. Over 256 conversions of a device its color averages
+ *      out to all 16 bits, so low level fades no longer step.
+ *
+ *      Only a streamed chain dithers: it converts every device on each 
+ *      refresh, so with setRefreshPeriod() the core timer service dithers
+ *      on its own; set a short refresh period, 2500uS or so, so the dither
+ *      does not flicker. A pattern buffer is only converted by an update
+ *      and its refreshes send the same bytes again, so it is refused. The
+ *      state is spread to start with so devices of the same color do not
+ *      all step together. 8 bit formats do not dither, and 16 bit formats
+ *      do not use the color tables; scale the 16 bit pixels instead. Call
+ *      after beginStream().
+ *
+ * ------------------------------------------------------------ */
+bool WS2812Core::setDither(uint8_t * pError, uint32_t cbError)
+{
+    uint32_t cbDither = _fInit ? _cDevices * (_cbDevice / _iBitSPIClocks) : 0;
+
+    if(pError != NULL && (!_fInit || !_fStream || cbError < cbDither))
+    {
+        return(false);
+    }
+
+    // 167 is odd, so a run of 256 gets every value once
+    for(uint32_t i = 0; pError != NULL && i < cbDither; i++)
+    {
+        pError[i] = (uint8_t) (i * 167);
+    }
+
+    _pDither = pError;
+
+    return(_pDither != NULL);
+}
+
+/***    bool WS2812Core::setPalettePixels(const void * rgPalette, uint32_t cPalette, uint8_t * pSymbols, uint32_t cbSymbols)
+ *
+ *    Parameters:
+ *          rgPalette:  Up to 256 colors, GRB structures or the PIXEL of the 
+ *                      WS2812T format, or NULL for no palette. The colors are
+ *                      read here and when the color tables change, so they
+ *                      must stay valid while the palette is set.
+ *
+ *          cPalette:   How many colors are in rgPalette
+ *
+ *          pSymbols:   CBWS2812PALETTE(cPalette) bytes, CBWS2812PALETTEFMT() 
+ *                      for a WS2812T format, for the cached symbols
+ *
+ *          cbSymbols:  The size of pSymbols
+ *
+ *    Return Values:
+ *          True if the palette is set, false if not begun, too many colors,
+ *          pSymbols is too small or, in MODE32, not word aligned
+ *
+ *    Description:
+ *
+ *      setPalette() in the sketch. Each palette color is converted once, 
+ *      here, into the symbols of a device, so updateIndexedLEDs() converts 
+ *      a device by copying its color's symbols into the pattern buffer. A 
+ *      chain of indexes is a third the size of one of GRB, and converts 
+ *      faster. Indexes past the end of the palette are sent as color 0.
+ *      Call again after changing rgPalette; every device is marked dirty.
+ *      16 bit formats are not dithered from a palette. Call after begin().
+ *
+ * ------------------------------------------------------------ */
+bool WS2812Core::setPalettePixels(const void * rgPalette, uint32_t cPalette, uint8_t * pSymbols, uint32_t cbSymbols)
+{
+    if(rgPalette != NULL && (!_fInit || cPalette == 0 || cPalette > 256 || pSymbols == NULL || cbSymbols < cPalette * _cbDevice ||
+                            (_fMode32 && ((uintptr_t) pSymbols & 3) != 0)))
+    {
+        return(false);
+    }
+
+    // a palette may not go away while an update or the stream is using it
+    if(rgPalette == NULL && ((_pPixels != NULL && _fIndexed) || _fStreamIndexed))
+    {
+        return(false);
+    }
+
+    _pPalette           = (const uint8_t *) rgPalette;
+    _cPalette           = (rgPalette != NULL) ? cPalette : 0;
+    _pPaletteSymbols    = (rgPalette != NULL) ? pSymbols : NULL;
+
+    expandPalette();
+    markDirty(0, _cDevices);
+
+    return(_pPalette != NULL);
+}
+
+/***    void WS2812Core::expandPalette(void)
+ *
+ *    Parameters:
+ *          None
+ *
+ *    Return Values:
+ *          None
+ *
+ *    Description:
+ *
+ *      Converts every palette color into the cached symbols, with
+ *      the color tables and inversion as they are now. The palette 
+ *      symbols are not dithered, the dither state is per device.
+ *
+ * ------------------------------------------------------------ */
+void WS2812Core::expandPalette(void)
+{
+    uint8_t * pDither = _pDither;
+
+    if(_pPalette == NULL)
+    {
+        return;
+    }
+
+    _pDither = NULL;
+    _pfnEncode(this, _pPaletteSymbols, _pPalette, 0, _cPalette);
+    _pDither = pDither;
+}
+
+/***    void WS2812Core::encode(uint8_t * pDst, const uint8_t * rgPixels, bool fIndexed, uint32_t iDevice, uint32_t cDevices)
+ *
+ *    Parameters:
+ *          pDst:       Where the first device goes
+ *
+ *          rgPixels:   The pixels, or the palette indexes, of the whole chain
+ *
+ *          fIndexed:   True if rgPixels are palette indexes
+ *
+ *          iDevice:    The first device to convert
+ *
+ *          cDevices:   How many devices to convert
+ *
+ *    Return Values:
+ *          None
+ *
+ *    Description:
+ *
+ *      Converts a run of devices for an update or a streamed refresh.
+ *      Indexes are copied from the palette symbols, the common device
+ *      sizes with a fixed size copy.
+ *
+ * ------------------------------------------------------------ */
+void WS2812Core::encode(uint8_t * pDst, const uint8_t * rgPixels, bool fIndexed, uint32_t iDevice, uint32_t cDevices)
+{
+    if(!fIndexed)
+    {
+        _pfnEncode(this, pDst, &rgPixels[iDevice * _cbPixel], iDevice, cDevices);
+        return;
+    }
+
+    switch(_cbDevice)
+    {
+        case CBWS2812PATBUFCOLORS(1, 3):
+            encodeIndexes<CBWS2812PATBUFCOLORS(1, 3)>(pDst, &rgPixels[iDevice], cDevices);
+            break;
+
+        case CBWS2812PATBUFCOLORS(1, 4):
+            encodeIndexes<CBWS2812PATBUFCOLORS(1, 4)>(pDst, &rgPixels[iDevice], cDevices);
+            break;
+
+        default:
+            encodeIndexes<0>(pDst, &rgPixels[iDevice], cDevices);
+            break;
+    }
+}
+
+template<uint32_t cbDevice>
+void WS2812Core::encodeIndexes(uint8_t * pDst, const uint8_t * pIndex, uint32_t cDevices)
+{
+    uint32_t cb = (cbDevice != 0) ? cbDevice : _cbDevice;
+
+    for(; cDevices > 0; cDevices--, pIndex++, pDst += cb)
+    {
+        uint32_t index = *pIndex;
+
+        if(index >= _cPalette)
+        {
+            index = 0;
+        }
+
+        memcpy(pDst, &_pPaletteSymbols[index * cb], cb);
+    }
+}
+
+/***    void WS2812Core::setFrameDone(PFNFRAMEDONE pfnFrameDone, void * pContext)
+ *
+ *    Parameters:
+ *          pfnFrameDone:   Called as pfnFrameDone(this, pContext) each time an
+ *                          update is on the chain, or NULL for no call
+ *
+ *          pContext:       Anything the sketch wants passed to pfnFrameDone
+ *
+ *    Return Values:
+ *          None
+ *
+ *    Description:
+ *
+ *      An update is on the chain once it has been shifted out and
+ *      the chain has latched it. The DMA done interrupt says when the
+ *      pattern buffer is out. pfnFrameDone is called from the core timer
+ *      service, so it should just set a flag or start the next update,
+ *      not wait on anything. May be called before or after begin().
+ *
+ * ------------------------------------------------------------ */
+void WS2812Core::setFrameDone(PFNFRAMEDONE pfnFrameDone, void * pContext)
+{
+    _pfnFrameDone       = pfnFrameDone;
+    _pFrameDoneContext  = pContext;
+}
+
+void WS2812Core::frameDone(void * pContext)
+{
+    WS2812Core * pThis = (WS2812Core *) pContext;
+
+    if(pThis->_pfnFrameDone != NULL)
+    {
+        pThis->_pfnFrameDone(pThis, pThis->_pFrameDoneContext);
+    }
+}
+
+/***    void WS2812Core::fillStream(void * pContext, uint8_t * pb, uint32_t ib, uint32_t cb)
+ *
+ *    Parameters:
+ *          pContext:   The WS2812Core that is streaming
+ *
+ *          pb:         Where to put the bytes
+ *
+ *          ib:         The first byte of the refresh wanted, on a device boundary
+ *
+ *          cb:         How many bytes, whole devices
+ *
+ *    Return Values:
+ *          None
+ *
+ *    Description:
+ *
+ *      Converts the devices for part of a streamed refresh. Called by the
+ *      driver from the core timer service and the DMA interrupt.
+ *
+ * ------------------------------------------------------------ */
+void WS2812Core::fillStream(void * pContext, uint8_t * pb, uint32_t ib, uint32_t cb)
+{
+    WS2812Core *    pThis   = (WS2812Core *) pContext;
+    const uint8_t * pPixels = pThis->_pStreamPixels;
+    uint32_t        tStart;
+
+    // only while an update switches between pixels and indexes, send a reset
+    if(pPixels == NULL)
+    {
+        memset(pb, pThis->_fInvert ? 0xFF : 0, cb);
+        return;
+    }
+
+    tStart = pThis->_pDriver->ticks();
+    pThis->encode(pb, pPixels, pThis->_fStreamIndexed, ib / pThis->_cbDevice, cb / pThis->_cbDevice);
+    pThis->_tEncodeFrame += pThis->_pDriver->ticks() - tStart;
+
+    // the end of the refresh, each refresh is converted as it goes
+    if(ib + cb == pThis->_cDevices * pThis->_cbDevice)
+    {
+        pThis->endEncode();
+    }
+}
+
+/***    void WS2812Core::setUpdateState(UST updateState)
+ *
+ *    Parameters:
+ *          updateState:    Where the update state machine goes next
+ *
+ *    Return Values:
+ *          None
+ *
+ *    Description:
+ *
+ *      Every move of the update state machine goes through here, 
+ *      so it can be traced.
+ *
+ * ------------------------------------------------------------ */
+void WS2812Core::setUpdateState(UST updateState)
+{
+    trace(WS2812_TRACE_STATE, updateState, _updateState | (_edit << 8));
+
+    if(updateState == WAITUPD)
+    {
+        _fRefused = false;
+    }
+    _updateState = updateState;
+}
+
+/***    bool WS2812Core::setTrace(uint8_t * pTrace, uint32_t cbTrace)
+ *
+ *    Parameters:
+ *          pTrace:     The ring, CBWS2812TRACE(cEvents) bytes, or NULL to stop tracing
+ *
+ *          cbTrace:    Its size, the ring is the largest power of 2 events that fit
+ *
+ *    Return Values:
+ *          True if tracing, or stopped for NULL; false if there is not room for an event
+ *
+ *    Description:
+ *
+ *      Records what the chain does with the core timer time it happened,
+ *      for working out after the fact why a frame glitched. The update 
+ *      state machine records its state moves, the first time an update 
+ *      finds the pattern buffer busy, aborts and commits; the driver 
+ *      records refreshes starting the pattern DMA channel, the channel
+ *      finishing, refreshes that are late and why, and updates reaching 
+ *      the chain. See WS2812_TRACE_STATE and on in WS2812Driver.h.
+ *
+ *      An event is an atomic add and 8 bytes of stores, and nothing at all
+ *      without a ring. The ring starts over empty on each call, and is 
+ *      kept over begin() and end(). dumpTrace() writes it out.
+ *
+ * ------------------------------------------------------------ */
+bool WS2812Core::setTrace(uint8_t * pTrace, uint32_t cbTrace)
+{
+    uint32_t cEvents    = 1;
+    uint32_t cbAlign    = (uint32_t) (-(uintptr_t) pTrace) & 3;
+
+    // stop the driver before the ring goes
+    if(_fInit)
+    {
+        _pDriver->setTrace(NULL);
+    }
+    _trace.pEvents = NULL;
+
+    if(pTrace == NULL)
+    {
+        return(true);
+    }
+
+    if(cbTrace < cbAlign + sizeof(WS2812EVENT))
+    {
+        return(false);
+    }
+    cbTrace -= cbAlign;
+
+    while(2 * cEvents * sizeof(WS2812EVENT) <= cbTrace)
+    {
+        cEvents *= 2;
+    }
+
+    _trace.mask     = cEvents - 1;
+    _trace.cWritten = 0;
+    _trace.fHold    = false;
+    _trace.pEvents  = (WS2812EVENT *) (pTrace + cbAlign);
+
+    if(_fInit)
+    {
+        _pDriver->setTrace(&_trace);
+    }
+
+    return(true);
+}
+
+/***    uint32_t WS2812Core::dumpTrace(PFNTRACEWRITE pfnWrite, void * pContext)
+ *
+ *    Parameters:
+ *          pfnWrite:   Called with the bytes to write, say to Serial.write()
+ *
+ *          pContext:   Passed to pfnWrite
+ *
+ *    Return Values:
+ *          The bytes written, 0 if not tracing
+ *
+ *    Description:
+ *
+ *      Writes a WS2812TRACEHDR and then the events in the ring, oldest
+ *      first, straight out of the ring in at most 3 calls to pfnWrite.
+ *      extras/host/WS2812Trace.cpp turns this into a timeline. Events 
+ *      that happen while this is writing are dropped, so the ring holds 
+ *      still; the ring is left as it was.
+ *
+ * ------------------------------------------------------------ */
+uint32_t WS2812Core::dumpTrace(PFNTRACEWRITE pfnWrite, void * pContext)
+{
+    WS2812TRACEHDR  hdr;
+    uint32_t        cEvents;
+    uint32_t        iFirst;
+    uint32_t        cFirst;
+
+    if(_trace.pEvents == NULL || pfnWrite == NULL)
+    {
+        return(0);
+    }
+
+    _trace.fHold = true;
+
+    memcpy(hdr.rgMagic, "WST1", sizeof(hdr.rgMagic));
+    hdr.cWritten    = _trace.cWritten;
+    hdr.tickRate    = CORE_TICK_RATE;
+    cEvents         = (hdr.cWritten > _trace.mask) ? _trace.mask + 1 : hdr.cWritten;
+    hdr.cEvents     = cEvents;
+    pfnWrite((const uint8_t *) &hdr, sizeof(hdr), pContext);
+
+    // from the oldest to the end of the ring, then round from the start
+    iFirst = (hdr.cWritten - cEvents) & _trace.mask;
+    cFirst = _trace.mask + 1 - iFirst;
+    if(cFirst > cEvents)
+    {
+        cFirst = cEvents;
+    }
+
+    if(cFirst > 0)
+    {
+        pfnWrite((const uint8_t *) &_trace.pEvents[iFirst], cFirst * sizeof(WS2812EVENT), pContext);
+    }
+    if(cEvents > cFirst)
+    {
+        pfnWrite((const uint8_t *) _trace.pEvents, (cEvents - cFirst) * sizeof(WS2812EVENT), pContext);
+    }
+
+    _trace.fHold = false;
+    return(sizeof(hdr) + (cEvents * sizeof(WS2812EVENT)));
+}
+
+/***    void WS2812Core::endEncode(void)
+ *
+ *    Parameters:
+ *          None
+ *
+ *    Return Values:
+ *          None
+ *
+ *    Description:
+ *
+ *      Adds the time the update just committed spent converting to
+ *      the counters, and starts the next one from 0. When streaming
+ *      this is every refresh, from the DMA interrupt.
+ *
+ * ------------------------------------------------------------ */
+void WS2812Core::endEncode(void)
+{
+    _tEncodeLast    = _tEncodeFrame;
+    _tEncode       += _tEncodeFrame;
+    _tEncodeFrame   = 0;
+
+    if(_tEncodeLast > _tEncodeMax)
+    {
+        _tEncodeMax = _tEncodeLast;
+    }
+}
+
+/***    void WS2812Core::getStats(STATS * pStats)
+ *
+ *    Parameters:
+ *          pStats: Gets the counters since begin() or clearStats()
+ *
+ *    Return Values:
+ *          None
+ *
+ *    Description:
+ *
+ *      For keeping an eye on a chain that runs unattended. The driver
+ *      counts refreshes started, how many were late because the pattern
+ *      buffer or the DMA was not ready when they were due, refresh periods 
+ *      missed altogether, the worst lateness, and how long the pattern DMA
+ *      channel has been busy. This counts the updates committed and the
+ *      core timer ticks spent converting them, timed around the encoders
+ *      with the core timer count the same way updateLEDsFor() times its 
+ *      budget. Waiting for the DMA is not counted as converting.
+ *
+ *      Every counter is a few adds per refresh or per pass of the update,
+ *      so they are always on. The 64 bit totals are for long runs; the 
+ *      duty cycle of the DMA is the change in tDMABusy over the change in
+ *      the core timer between two calls.
+ *
+ * ------------------------------------------------------------ */
+void WS2812Core::getStats(STATS * pStats)
+{
+    memset(pStats, 0, sizeof(STATS));
+    _pDriver->getStats(pStats);
+
+    pStats->cFrames     = _cFrames;
+    pStats->cCaught     = _cCaught;
+    pStats->tEncodeLast = _tEncodeLast;
+    pStats->tEncodeMax  = _tEncodeMax;
+    pStats->tEncode     = _tEncode;
+}
+
+/***    void WS2812Core::clearStats(void)
+ *
+ *    Parameters:
+ *          None
+ *
+ *    Return Values:
+ *          None
+ *
+ *    Description:
+ *
+ *      Starts all of the counters of getStats() over. An update in
+ *      progress keeps what it has spent converting so far.
+ *
+ * ------------------------------------------------------------ */
+void WS2812Core::clearStats(void)
+{
+    _pDriver->clearStats();
+    _cFrames        = 0;
+    _cCaught        = 0;
+    _tEncodeLast    = 0;
+    _tEncodeMax     = 0;
+    _tEncode        = 0;
+}
+
+/***    bool WS2812Core::isBusy(void)
+ *
+ *    Parameters:
+ *          None
+ *
+ *    Return Values:
+ *          True from when an update starts until it is on the chain
+ *
+ *    Description:
+ *
+ *      While an update is being converted, updateLEDs() has to be
+ *      called until it returns true; after that the update only has
+ *      to go out, and the sketch is free to do other work.
+ *
+ * ------------------------------------------------------------ */
+bool WS2812Core::isBusy(void)
+{
+    return(_fInit && (_pPixels != NULL || _pDriver->isFrameBusy()));
+}
+
+/***    bool WS2812Core::waitIdle(uint32_t msTimeout)
+ *
+ *    Parameters:
+ *          msTimeout:  The most mS to wait
+ *
+ *    Return Values:
+ *          True once the last update is on the chain, false on a time out
+ *          or if an update is still being converted
+ *
+ *    Description:
+ *
+ *      Waits for the last update that updateLEDs() finished to be 
+ *      shifted out and latched. Waiting can not finish converting an 
+ *      update, so this does not wait if one is in progress.
+ *
+ * ------------------------------------------------------------ */
+bool WS2812Core::waitIdle(uint32_t msTimeout)
+{
+    if(!_fInit)
+    {
+        return(true);
+    }
+
+    if(_pPixels != NULL)
+    {
+        return(false);
+    }
+
+    return(_pDriver->waitFrame(msTimeout * CORE_TICK_RATE));
+}
+
+/***    void  WS2812Core::abortUpdate(void)
+ *
+ *    Parameters:
+ *          None
+ *
+ *    Return Values:
+ *          None
+ *
+ *    Description:
+ *
+ *      Terminates updating the pattern buffer to a new
+ *      data stream to the WS2812. Because the pattern
+ *      buffer is most likely in an unfinished state
+ *      the WS2812 will have no valid pattern buffer to
+ *      refresh the chain; so the DMA will be left in
+ *      the reset cycle. Since the pattern isn't 
+ *      being refreshed, the WS2812 may 
+ *      incur noise on the chain and start displaying
+ *      unexpected results. updateLEDs() should be called
+ *      with a new pattern to re-engage the pattern buffer
+ *      on a regular refresh cycle.
+ *
+ *      When double buffered the unfinished pattern is in
+ *      the back pattern buffer, so the chain keeps being
+ *      refreshed with the last completed update. An update
+ *      that started early, see setEarlyStart(), has already
+ *      let the refresh go, so the chain keeps being refreshed
+ *      with what was converted.
+ *
+ *      The devices the aborted update was converting are
+ *      marked dirty again for the next updateDirtyLEDs().
+ * ------------------------------------------------------------ */
+void  WS2812Core::abortUpdate(void)
+{
+        if(_pPixels != NULL)
+        {
+            trace(WS2812_TRACE_ABORT, 0, devicesLeft());
+            for(uint32_t i = 0; i < _cUpdate; i++)
+            {
+                markDirty(_rgUpdate[i].iFirst, _rgUpdate[i].iEnd - _rgUpdate[i].iFirst);
+            }
+        }
+
+        _pPixels        = NULL;
+        _edit           = EDITNONE;
+        _iNextDevice    = 0;
+        _fCaught        = false;
+        if(_fEarly)
+        {
+            _fEarly = false;
+            updateRefresh();
+        }
+        setUpdateState(INIT);
+        if(!_fStream)
+        {
+            _tEncodeFrame   = 0;
+        }
+}
+
+/***    bool WS2812Core::updatePixels(const void * rgPixels, uint32_t cPass, bool fIndexed)
+ *
+ *    Parameters:
+ *          rgPixels: An array of pixels, one per device, that contains the 
+ *                  the value for each Green, Red, or Blue pixel in
+ *                  the device. Values may be from 0 to 255. These are
+ *                  GRB structures, or the PIXEL of the WS2812T format.
+ *                  This point must NOT change until updateLEDs() returns true.
+ *
+ *          cPass:  How many devices to convert in the pattern buffer per call to
+ *                  updateLEDs(). This allows you to control how long you say in updateLEDs()
+ *                  The default value is to convert 5 devices per call to updateLEDs().
+ *
+ *          fIndexed:   True if rgPixels are palette indexes, see setPalette()
+ *
+ *    Return Values:
+ *          False while updateLEDs() is still working to convert devices.
+ *          True when all devices have been converted.
+ *
+ *    Description:
+ *
+ *      This will return false until the DMA is stream the refresh cycle
+ *      and until all devices have been converted into the pattern buffer.
+ *      Once everything is done, this will return true and then you can change
+ *      rgGRB to a new pattern. You need to repeatedly call updateLEDs() until it 
+ *      returns true.
+ *
+ * ------------------------------------------------------------ */
+bool WS2812Core::updatePixels(const void * rgPixels, uint32_t cPass, bool fIndexed)
+{
+    // a new update, every device is converted
+    if(_updateState == INIT)
+    {
+        markDirty(0, _cDevices);
+    }
+
+    return(updateDirtyPixels(rgPixels, cPass, fIndexed));
+}
+
+/***    void WS2812Core::markDirty(uint32_t iDevice, uint32_t cDevices)
+ *
+ *    Parameters:
+ *          iDevice:    The first device that changed
+ *
+ *          cDevices:   How many devices changed, starting at iDevice
+ *
+ *    Return Values:
+ *          None
+ *
+ *    Description:
+ *
+ *      Marks devices as changed, so the next updateDirtyLEDs() converts them.
+ *      Dirty devices are kept as up to WS2812_DIRTY_RANGES ranges, in
+ *      order; marks that overlap or touch are joined, and when there are
+ *      too many ranges the 2 with the fewest devices between them are 
+ *      joined, so those devices are converted too. The ranges are cleared
+ *      when an update starts.
+ *
+ * ------------------------------------------------------------ */
+void WS2812Core::markDirty(uint32_t iDevice, uint32_t cDevices)
+{
+    uint32_t    iFirst;
+    uint32_t    iEnd;
+    uint32_t    i;
+    uint32_t    j;
+
+    if(iDevice >= _cDevices || cDevices == 0)
+    {
+        return;
+    }
+
+    if(cDevices > _cDevices - iDevice)
+    {
+        cDevices = _cDevices - iDevice;
+    }
+    iFirst  = iDevice;
+    iEnd    = iDevice + cDevices;
+
+    // past the ranges before it, then join the ones it overlaps or touches
+    for(i = 0; i < _cDirty && _rgDirty[i].iEnd < iFirst; i++);
+    for(j = i; j < _cDirty && _rgDirty[j].iFirst <= iEnd; j++)
+    {
+        if(_rgDirty[j].iFirst < iFirst)
+        {
+            iFirst = _rgDirty[j].iFirst;
+        }
+        if(_rgDirty[j].iEnd > iEnd)
+        {
+            iEnd = _rgDirty[j].iEnd;
+        }
+    }
+
+    // it takes the place of the ones it joined, or goes in between
+    memmove(&_rgDirty[i + 1], &_rgDirty[j], (_cDirty - j) * sizeof(DEVRANGE));
+    _rgDirty[i].iFirst  = iFirst;
+    _rgDirty[i].iEnd    = iEnd;
+    _cDirty            += 1 + i - j;
+
+    // one too many, join the 2 closest
+    if(_cDirty > WS2812_DIRTY_RANGES)
+    {
+        j = 0;
+        for(i = 1; i + 1 < _cDirty; i++)
+        {
+            if(_rgDirty[i + 1].iFirst - _rgDirty[i].iEnd < _rgDirty[j + 1].iFirst - _rgDirty[j].iEnd)
+            {
+                j = i;
+            }
+        }
+
+        _rgDirty[j].iEnd = _rgDirty[j + 1].iEnd;
+        memmove(&_rgDirty[j + 1], &_rgDirty[j + 2], (_cDirty - j - 2) * sizeof(DEVRANGE));
+        _cDirty--;
+    }
+}
+
+/***    bool WS2812Core::updateDirtyPixels(const void * rgPixels, uint32_t cPass, bool fIndexed)
+ *
+ *    Parameters:
+ *          rgPixels: An array of pixels with a value for every
+ *                  device in the chain, as for updateLEDs().
+ *                  This point must NOT change until updateDirtyLEDs() returns true.
+ *
+ *          cPass:  How many devices to convert in the pattern buffer per call to
+ *                  updateDirtyLEDs(), as for updateLEDs().
+ *
+ *          fIndexed:   True if rgPixels are palette indexes, see setPalette()
+ *
+ *    Return Values:
+ *          False while updateDirtyLEDs() is still working to convert devices.
+ *          True when all dirty devices have been converted.
+ *
+ *    Description:
+ *
+ *      Works like updateLEDs() but only converts the devices marked with
+ *      markDirty() since the last update started, so the time it takes follows 
+ *      how many devices changed instead of the length of the chain. The dirty
+ *      ranges are converted in order, and the rest of the pattern buffer is
+ *      left as the last update converted it.
+ *
+ *      When double buffered, the back pattern buffer is missing what the 
+ *      last update changed as well; those devices are copied from the front 
+ *      pattern buffer first, which is much quicker than converting them.
+ *
+ * ------------------------------------------------------------ */
+bool WS2812Core::updateDirtyPixels(const void * rgPixels, uint32_t cPass, bool fIndexed)
+{
+    const uint8_t * pPixels = (const uint8_t *) rgPixels;
+
+    if(!_fInit)
+    {
+        return(false);
+    }
+
+    switch(_updateState)
+    {
+        case INIT:
+            // indexes need a palette
+            if(_pPixels == NULL && (!fIndexed || _pPalette != NULL))
+            {
+                _pPixels        = pPixels;
+                _fIndexed       = fIndexed;
+                memcpy(_rgUpdate, _rgDirty, _cDirty * sizeof(DEVRANGE));
+                _cUpdate        = _cDirty;
+                _iUpdate        = 0;
+                _cDirty         = 0;
+                _iFirstDevice   = (_cUpdate != 0) ? _rgUpdate[0].iFirst : 0;
+                _iEndDevice     = (_cUpdate != 0) ? _rgUpdate[0].iEnd : 0;
+                _iNextDevice    = _iFirstDevice;
+                setUpdateState(WAITUPD);
+            }
+            break;
+
+        case WAITUPD:
+            if(_pPatternBufferFront != NULL ? _pDriver->startSwapUpdate() : _pDriver->startUpdate())
+            {
+                // the back pattern buffer is behind by whatever the last update changed, copy that from the front
+                if(_cStale != 0)
+                {
+                    uint32_t tStart = _pDriver->ticks();
+
+                    for(uint32_t i = 0; i < _cStale; i++)
+                    {
+                        uint32_t ib = _rgStale[i].iFirst * _cbDevice;
+
+                        memcpy(&_pPatternBuffer[ib], &_pPatternBufferFront[ib], (_rgStale[i].iEnd - _rgStale[i].iFirst) * _cbDevice);
+                    }
+                    _cStale         = 0;
+                    _tEncodeFrame  += _pDriver->ticks() - tStart;
+                }
+
+                // nothing marked dirty, nothing to convert
+                setUpdateState((_cUpdate == 0 && _edit == EDITNONE && !_fStream) ? ENDUPD : CONVGRB);
+            }
+            else if(!_fRefused)
+            {
+                _fRefused = true;
+                trace(WS2812_TRACE_REFUSED, _pPatternBufferFront != NULL, 0);
+            }
+            break;
+
+        case CONVGRB:
+            // streaming, the refreshes convert straight from rgPixels
+            if(_fStream && _pPixels == pPixels && _fIndexed == fIndexed && _edit == EDITNONE)
+            {
+                if(_fStreamIndexed != _fIndexed)
+                {
+                    _pStreamPixels  = NULL;
+                    _fStreamIndexed = _fIndexed;
+                }
+                _pStreamPixels  = pPixels;
+                setUpdateState(ENDUPD);
+            }
+            else if(_pPixels == pPixels && _fIndexed == fIndexed && _edit == EDITNONE)
+            {
+                uint32_t cDevices   = _iEndDevice - _iNextDevice;
+                uint32_t tStart     = _pDriver->ticks();
+
+                // the refresh is going, get cEarly devices ahead of the DMA again
+                if(_fEarly)
+                {
+                    uint32_t iSent = _pDriver->cbSent() / _cbDevice;
+
+                    if(iSent > _iNextDevice && !_fCaught)
+                    {
+                        _fCaught = true;
+                        _cCaught++;
+                    }
+
+                    if(iSent + _cEarly > _iNextDevice + cPass)
+                    {
+                        cPass = iSent + _cEarly - _iNextDevice;
+                    }
+                }
+
+                if(cDevices > cPass)
+                {
+                    cDevices = cPass;
+                }
+
+                encode(&_pPatternBuffer[_iNextDevice * _cbDevice], pPixels, _fIndexed, _iNextDevice, cDevices);
+                _iNextDevice   += cDevices;
+                _tEncodeFrame  += _pDriver->ticks() - tStart;
+
+                // on to the next dirty range
+                if(_iNextDevice == _iEndDevice && _iUpdate + 1 < _cUpdate)
+                {
+                    _iUpdate++;
+                    _iFirstDevice   = _rgUpdate[_iUpdate].iFirst;
+                    _iEndDevice     = _rgUpdate[_iUpdate].iEnd;
+                    _iNextDevice    = _iFirstDevice;
+                }
+
+                if(_iNextDevice == _iEndDevice)
+                {
+                    setUpdateState(ENDUPD);
+                }
+
+                // far enough ahead of where the DMA starts to let it go
+                else if(!_fEarly && _cEarly != 0 && _iNextDevice >= _cEarly && _pPatternBufferFront == NULL)
+                {
+                    _fEarly = true;
+                    trace(WS2812_TRACE_EARLY, 0, _iNextDevice);
+                    updateRefresh();
+                    _pDriver->endUpdate();
+                }
+            }
+            break;
+
+        case ENDUPD:
+            if(_trace.pEvents != NULL)
+            {
+                uint32_t cDevices = 0;
+
+                for(uint32_t i = 0; i < _cUpdate; i++)
+                {
+                    cDevices += _rgUpdate[i].iEnd - _rgUpdate[i].iFirst;
+                }
+                trace(WS2812_TRACE_COMMIT, _pPatternBufferFront != NULL, cDevices);
+            }
+            _pPixels        = NULL;
+            _edit           = EDITNONE;
+            _iNextDevice    = 0;
+            setUpdateState(INIT);
+            _cFrames++;
+            if(!_fStream)
+            {
+                endEncode();
+            }
+            if(_pPatternBufferFront != NULL)
+            {
+                uint8_t * pPatternBuffer = _pPatternBufferFront;
+
+                // once swapped, the old front pattern buffer is missing this update
+                memcpy(_rgStale, _rgUpdate, _cUpdate * sizeof(DEVRANGE));
+                _cStale         = _cUpdate;
+
+                _pDriver->swapUpdate(_pPatternBuffer);
+                _pPatternBufferFront    = _pPatternBuffer;
+                _pPatternBuffer         = pPatternBuffer;
+            }
+            else if(_fEarly)
+            {
+                // the DMA finished before the conversion did
+                if(!_fCaught && !_pDriver->isFrameBusy())
+                {
+                    _cCaught++;
+                }
+                _fEarly     = false;
+                _fCaught    = false;
+                updateRefresh();
+            }
+            else
+            {
+                _pDriver->endUpdate();
+            }
+            return(true);
+            break;
+
+        default:
+            break;
+    }
+
+    return(false);
+}
+
+/***    bool WS2812Core::fillPixels(const void * rgPattern, uint32_t cPattern, uint32_t iDevice, uint32_t cDevices)
+ *
+ *    Parameters:
+ *          rgPattern:  The pixels to repeat, GRB structures or the PIXEL of
+ *                      the WS2812T format. Just one for fillLEDs().
+ *                      This point must NOT change until fillLEDs() returns true.
+ *
+ *          cPattern:   How many pixels are in rgPattern
+ *
+ *          iDevice:    The first device to fill, it gets rgPattern[0]
+ *
+ *          cDevices:   How many devices to fill, the default is to the end of the chain
+ *
+ *    Return Values:
+ *          False while fillLEDs() is still working, true when the 
+ *          devices are filled.
+ *
+ *    Description:
+ *
+ *      fillLEDs() and repeatLEDs() in the sketch. Works like updateLEDs(),
+ *      call until it returns true, but without a pixel for every device:
+ *      rgPattern is converted once into the first devices of the range, 
+ *      and those symbols are copied over the rest of the range, doubling 
+ *      each copy, so a fill runs at the speed of memcpy(). The rest of the 
+ *      chain is left as it was, and the devices marked dirty are left for
+ *      the next updateDirtyLEDs(). The pattern is not dithered. A streamed
+ *      chain has no pattern buffer to fill, so this always returns false.
+ *
+ * ------------------------------------------------------------ */
+bool WS2812Core::fillPixels(const void * rgPattern, uint32_t cPattern, uint32_t iDevice, uint32_t cDevices)
+{
+    if(!_fInit || _fStream || rgPattern == NULL || cPattern == 0)
+    {
+        return(false);
+    }
+
+    switch(_updateState)
+    {
+        case INIT:
+            if(_pPixels == NULL && iDevice < _cDevices)
+            {
+                if(cDevices > _cDevices - iDevice)
+                {
+                    cDevices = _cDevices - iDevice;
+                }
+
+                _pPixels        = (const uint8_t *) rgPattern;
+                _fIndexed       = false;
+                _edit           = EDITFILL;
+                _cFill          = cPattern;
+                _iFirstDevice   = iDevice;
+                _iEndDevice     = iDevice + cDevices;
+                _iNextDevice    = _iFirstDevice;
+                _rgUpdate[0].iFirst = _iFirstDevice;
+                _rgUpdate[0].iEnd   = _iEndDevice;
+                _cUpdate        = 1;
+                _iUpdate        = 0;
+                setUpdateState(WAITUPD);
+            }
+            break;
+
+        case CONVGRB:
+            if(_edit == EDITFILL)
+            {
+                uint32_t tStart = _pDriver->ticks();
+
+                encodeRepeat();
+                _tEncodeFrame  += _pDriver->ticks() - tStart;
+                _iNextDevice    = _iEndDevice;
+                setUpdateState(ENDUPD);
+            }
+            break;
+
+        // waiting for the DMA and finishing up are as for any update
+        default:
+            if(_edit == EDITFILL)
+            {
+                return(updateDirtyPixels(rgPattern, 1));
+            }
+            break;
+    }
+
+    return(false);
+}
+
+/***    void WS2812Core::encodeRepeat(void)
+ *
+ *    Parameters:
+ *          None
+ *
+ *    Return Values:
+ *          None
+ *
+ *    Description:
+ *
+ *      Converts the fill pattern into the start of the devices being
+ *      filled, then copies what is done onto the end of itself until
+ *      the devices are full. Every copy is a whole number of patterns,
+ *      so the pattern stays in step.
+ *
+ * ------------------------------------------------------------ */
+void WS2812Core::encodeRepeat(void)
+{
+    uint8_t *   pDst        = &_pPatternBuffer[_iFirstDevice * _cbDevice];
+    uint32_t    cDevices    = _iEndDevice - _iFirstDevice;
+    uint32_t    cb          = cDevices * _cbDevice;
+    uint32_t    cbDone;
+    uint8_t *   pDither     = _pDither;
+
+    if(_cFill < cDevices)
+    {
+        cDevices = _cFill;
+    }
+
+    _pDither = NULL;
+    _pfnEncode(this, pDst, _pPixels, _iFirstDevice, cDevices);
+    _pDither = pDither;
+
+    for(cbDone = cDevices * _cbDevice; cbDone < cb; cbDone *= 2)
+    {
+        memcpy(&pDst[cbDone], pDst, (cbDone < cb - cbDone) ? cbDone : cb - cbDone);
+    }
+}
+
+/***    bool WS2812Core::scrollPixels(int32_t cShift, const void * rgPixels)
+ *
+ *    Parameters:
+ *          cShift:     How many devices to move the chain towards its end,
+ *                      device i shows what device i - cShift showed; 
+ *                      negative moves it towards the start
+ *
+ *          rgPixels:   NULL to rotate, the devices moved off one end come 
+ *                      back on the other. Or an array of pixels with a value
+ *                      for every device in the chain, as for updateLEDs(), 
+ *                      of which only the devices moved onto the chain are 
+ *                      converted: rgPixels[0] to rgPixels[cShift - 1] for a 
+ *                      positive cShift.
+ *                      This point must NOT change until scrollLEDs() returns true.
+ *
+ *    Return Values:
+ *          False while scrollLEDs() is still working, true when the 
+ *          chain is scrolled.
+ *
+ *    Description:
+ *
+ *      scrollLEDs() in the sketch. Works like updateLEDs(), call until it
+ *      returns true. Every device is a fixed number of bytes in the pattern
+ *      buffer, so the symbols already there are moved rather than converted 
+ *      again, and only the devices moved onto the chain are converted; 
+ *      scrolling a marquee by one converts one device, or none, whatever the
+ *      length of the chain. The devices marked dirty are left for the next
+ *      updateDirtyLEDs(), they do not move with the chain. A streamed chain 
+ *      has no pattern buffer to scroll, so this always returns false.
+ *
+ * ------------------------------------------------------------ */
+bool WS2812Core::scrollPixels(int32_t cShift, const void * rgPixels)
+{
+    if(!_fInit || _fStream)
+    {
+        return(false);
+    }
+
+    switch(_updateState)
+    {
+        case INIT:
+            if(_pPixels == NULL)
+            {
+                // there are no pixels when rotating, but an update needs something to go on
+                _pPixels        = (rgPixels != NULL) ? (const uint8_t *) rgPixels : _pPatternBuffer;
+                _fIndexed       = false;
+                _edit           = EDITSCROLL;
+                _cShift         = cShift;
+                _iFirstDevice   = 0;
+                _iEndDevice     = _cDevices;
+                _iNextDevice    = _iFirstDevice;
+                _rgUpdate[0].iFirst = _iFirstDevice;
+                _rgUpdate[0].iEnd   = _iEndDevice;
+                _cUpdate        = 1;
+                _iUpdate        = 0;
+                setUpdateState(WAITUPD);
+            }
+            break;
+
+        case CONVGRB:
+            if(_edit == EDITSCROLL)
+            {
+                uint32_t tStart = _pDriver->ticks();
+
+                scrollPatternBuffer();
+                _tEncodeFrame  += _pDriver->ticks() - tStart;
+                _iNextDevice    = _iEndDevice;
+                setUpdateState(ENDUPD);
+            }
+            break;
+
+        // waiting for the DMA and finishing up are as for any update
+        default:
+            if(_edit == EDITSCROLL)
+            {
+                return(updateDirtyPixels(_pPixels, 1));
+            }
+            break;
+    }
+
+    return(false);
+}
+
+/***    void WS2812Core::scrollPatternBuffer(void)
+ *
+ *    Parameters:
+ *          None
+ *
+ *    Return Values:
+ *          None
+ *
+ *    Description:
+ *
+ *      Moves the devices of the pattern buffer by _cShift, and
+ *      converts the ones moved on from _pPixels unless rotating.
+ *
+ * ------------------------------------------------------------ */
+void WS2812Core::scrollPatternBuffer(void)
+{
+    bool        fRotate = (_pPixels == _pPatternBuffer);
+    uint32_t    cMove   = (_cShift < 0) ? (uint32_t) -(_cShift + 1) + 1 : (uint32_t) _cShift;
+
+    if(fRotate)
+    {
+        cMove %= _cDevices;
+        rotateDevices((_cShift < 0) ? cMove : _cDevices - cMove);
+    }
+
+    // everything is moved off
+    else if(cMove >= _cDevices)
+    {
+        encode(_pPatternBuffer, _pPixels, false, 0, _cDevices);
+    }
+
+    else if(_cShift > 0)
+    {
+        memmove(&_pPatternBuffer[cMove * _cbDevice], _pPatternBuffer, (_cDevices - cMove) * _cbDevice);
+        encode(_pPatternBuffer, _pPixels, false, 0, cMove);
+    }
+
+    else if(_cShift < 0)
+    {
+        memmove(_pPatternBuffer, &_pPatternBuffer[cMove * _cbDevice], (_cDevices - cMove) * _cbDevice);
+        encode(&_pPatternBuffer[(_cDevices - cMove) * _cbDevice], _pPixels, false, _cDevices - cMove, cMove);
+    }
+}
+
+/***    void WS2812Core::rotateDevices(uint32_t cLeft)
+ *
+ *    Parameters:
+ *          cLeft:  How many devices to rotate the pattern buffer towards
+ *                  its start, less than the number of devices
+ *
+ *    Return Values:
+ *          None
+ *
+ *    Description:
+ *
+ *      A short rotation, the usual scroll, goes through a small buffer
+ *      on the stack with one memmove(); a long one reverses the two parts
+ *      and then the whole pattern buffer, a device at a time.
+ *
+ * ------------------------------------------------------------ */
+void WS2812Core::rotateDevices(uint32_t cLeft)
+{
+    uint8_t     rgb[16 * CBWS2812PATBUFCOLORS(1, 4)];
+    uint32_t    cRight  = _cDevices - cLeft;
+    uint32_t    cbLeft  = cLeft * _cbDevice;
+    uint32_t    cbRight = cRight * _cbDevice;
+
+    if(cLeft == 0)
+    {
+        return;
+    }
+
+    else if(cbLeft <= sizeof(rgb))
+    {
+        memcpy(rgb, _pPatternBuffer, cbLeft);
+        memmove(_pPatternBuffer, &_pPatternBuffer[cbLeft], cbRight);
+        memcpy(&_pPatternBuffer[cbRight], rgb, cbLeft);
+    }
+
+    else if(cbRight <= sizeof(rgb))
+    {
+        memcpy(rgb, &_pPatternBuffer[cbLeft], cbRight);
+        memmove(&_pPatternBuffer[cbRight], _pPatternBuffer, cbLeft);
+        memcpy(_pPatternBuffer, rgb, cbRight);
+    }
 
-    // apply a zero to the pattern buffer
     else
     {
-        i = 0;
+        reverseDevices(0, cLeft);
+        reverseDevices(cLeft, _cDevices);
+        reverseDevices(0, _cDevices);
+    }
+}
+
+void WS2812Core::reverseDevices(uint32_t iFirst, uint32_t iEnd)
+{
+    uint8_t rgb[CBWS2812PATBUFCOLORS(1, 4)];
+
+    for(; iFirst + 1 < iEnd; iFirst++, iEnd--)
+    {
+        memcpy(rgb, &_pPatternBuffer[iFirst * _cbDevice], _cbDevice);
+        memcpy(&_pPatternBuffer[iFirst * _cbDevice], &_pPatternBuffer[(iEnd - 1) * _cbDevice], _cbDevice);
+        memcpy(&_pPatternBuffer[(iEnd - 1) * _cbDevice], rgb, _cbDevice);
+    }
+}
+
+/***    bool WS2812Core::updatePixelsFor(const void * rgPixels, uint32_t usBudget, bool fIndexed)
+ *
+ *    Parameters:
+ *          rgPixels:   An array of pixels with a value for every
+ *                      device in the chain, as for updateLEDs().
+ *                      This point must NOT change until updateLEDsFor() returns true.
+ *
+ *          usBudget:   How many microseconds this call may spend converting devices
+ *
+ *          fIndexed:   True if rgPixels are palette indexes, see setPalette()
+ *
+ *    Return Values:
+ *          False while updateLEDsFor() is still working to convert devices.
+ *          True when all devices have been converted.
+ *
+ *    Description:
+ *
+ *      Works like updateLEDs() but instead of a fixed number of devices
+ *      per call, converts as many devices as fit in usBudget. 
+ *      See updateDirtyLEDsFor().
+ *
+ * ------------------------------------------------------------ */
+bool WS2812Core::updatePixelsFor(const void * rgPixels, uint32_t usBudget, bool fIndexed)
+{
+    // a new update, every device is converted
+    if(_updateState == INIT)
+    {
+        markDirty(0, _cDevices);
+    }
+
+    return(updateDirtyPixelsFor(rgPixels, usBudget, fIndexed));
+}
+
+/***    bool WS2812Core::updateDirtyPixelsFor(const void * rgPixels, uint32_t usBudget, bool fIndexed)
+ *
+ *    Parameters:
+ *          rgPixels:   An array of pixels with a value for every
+ *                      device in the chain, as for updateLEDs().
+ *                      This point must NOT change until updateDirtyLEDsFor() returns true.
+ *
+ *          usBudget:   How many microseconds this call may spend converting devices
+ *
+ *          fIndexed:   True if rgPixels are palette indexes, see setPalette()
+ *
+ *    Return Values:
+ *          False while updateDirtyLEDsFor() is still working to convert devices.
+ *          True when all dirty devices have been converted.
+ *
+ *    Description:
+ *
+ *      Works like updateDirtyLEDs() but runs the update for up to usBudget,
+ *      timed with the core timer count. The time to convert a device is
+ *      measured as devices are converted, and each pass converts as many 
+ *      devices as that says will fit in what is left of the budget, so
+ *      a call may run over by about the time of one device. At least one
+ *      device is converted per call, even with a budget of 0; a call
+ *      that starts the update runs on through to its first device.
+ *
+ *      This returns early, without using up the budget, when the update
+ *      is waiting for the DMA to give up the pattern buffer. devicesLeft()
+ *      says how far the update got.
+ *
+ * ------------------------------------------------------------ */
+bool WS2812Core::updateDirtyPixelsFor(const void * rgPixels, uint32_t usBudget, bool fIndexed)
+{
+    uint32_t    tBudget     = usBudget * (CORE_TICK_RATE / 1000);
+    bool        fConverted  = false;
+    uint32_t    tStart;
+    uint32_t    tNow;
+
+    if(!_fInit)
+    {
+        return(false);
+    }
+
+    tStart  = _pDriver->ticks();
+    tNow    = tStart;
+
+    do
+    {
+        UST         updateState = _updateState;
+        uint32_t    iNextDevice = _iNextDevice;
+        uint32_t    tPass       = tNow;
+        uint32_t    cPass       = 1;
+
+        // as many devices as should fit in what is left
+        if(updateState == CONVGRB && _tDevice != 0)
+        {
+            uint32_t tLeft = tBudget - (tNow - tStart);
+
+            if(tLeft > (0xFFFFFFFF / 16))
+            {
+                tLeft = 0xFFFFFFFF / 16;
+            }
+
+            cPass = (tLeft * 16) / _tDevice;
+
+            if(cPass == 0)
+            {
+                if(fConverted)
+                {
+                    break;
+                }
+                cPass = 1;
+            }
+        }
+
+        if(updateDirtyPixels(rgPixels, cPass, fIndexed))
+        {
+            return(true);
+        }
+
+        tNow = _pDriver->ticks();
 
-        // This while loops inserts '1's into the bitstream for as many SPI
-        // clocks as we need in order to represent the 'high' part of a '0' symbol
-        while(i < _iBit0SPIClocksHigh)
+        if(updateState == CONVGRB)
         {
-            for(; _iBit < 8 && i < _iBit0SPIClocksHigh; _iBit++, i++)
+            uint32_t cDevices   = _iNextDevice - iNextDevice;
+            uint32_t tDevice    = tNow - tPass;
+
+            // rgPixels is not the array being converted
+            if(cDevices == 0)
+            {
+                break;
+            }
+
+            if(tDevice > (0xFFFFFFFF / 16))
             {
-                _pPatternBuffer[_iByte] |= ((uint8_t)(1 << (7-_iBit)));
+                tDevice = 0xFFFFFFFF / 16;
             }
 
-            if(_iBit == 8)
+            tDevice = (tDevice * 16) / cDevices;
+            if(tDevice == 0)
             {
-                _iBit = 0;
-                _iByte++;
+                tDevice = 1;
             }
+
+            _tDevice    = (_tDevice == 0) ? tDevice : ((3 * _tDevice) + tDevice) / 4;
+            fConverted  = true;
+        }
+
+        // waiting for the DMA
+        else if(_updateState == updateState)
+        {
+            break;
+        }
+
+    // finishing the update is not worth another call, nor is starting one
+    } while(tNow - tStart < tBudget || _updateState == ENDUPD || !fConverted);
+
+    return(false);
+}
+
+/***    uint32_t WS2812Core::devicesLeft(void)
+ *
+ *    Parameters:
+ *          None
+ *
+ *    Return Values:
+ *          How many devices the update in progress has yet to convert,
+ *          0 if there is no update in progress.
+ *
+ *    Description:
+ *
+ *      Lets a scheduler see how far an update got, say to 
+ *      size the next updateLEDsFor() budget.
+ *
+ * ------------------------------------------------------------ */
+uint32_t WS2812Core::devicesLeft(void)
+{
+    uint32_t cDevices;
+
+    if(_pPixels == NULL)
+    {
+        return(0);
+    }
+
+    cDevices = _iEndDevice - _iNextDevice;
+    for(uint32_t i = _iUpdate + 1; i < _cUpdate; i++)
+    {
+        cDevices += _rgUpdate[i].iEnd - _rgUpdate[i].iFirst;
+    }
+
+    return(cDevices);
+}
+
+/***    void WS2812::buildSymbols(void)
+ *
+ *    Parameters:
+ *          None
+ *
+ *    Return Values:
+ *          None
+ *
+ *    Description:
+ *
+ *      A private method to build the color byte to SPI pattern lookup
+ *      table from the bit timings passed to begin().
+ *
+ *      The full table holds the pattern of a whole color byte in the
+ *      order the bytes go into the pattern buffer, so it can be stored
+ *      as is. The PIC32 is little endian, so the first SPI byte is the
+ *      low byte of the word. The nibble table holds the pattern of 4
+ *      color bits with the first SPI clock in the MSb; two of these are
+ *      joined and swapped into pattern buffer order by the encoder.
+ *
+ *      When the signal is inverted the table holds the inverted
+ *      patterns, so inverting costs nothing when converting.
+ *
+ * ------------------------------------------------------------ */
+void WS2812::buildSymbols(void)
+{
+    uint32_t symbol1 = ((1 << _iBit1SPIClocksHigh) - 1) << (_iBitSPIClocks - _iBit1SPIClocksHigh);
+    uint32_t symbol0 = ((1 << _iBit0SPIClocksHigh) - 1) << (_iBitSPIClocks - _iBit0SPIClocksHigh);
+    uint32_t i = 0;
+
+    // the table encoder only handles color bytes that fit in a word
+    if(_iBitSPIClocks > 4)
+    {
+        return;
+    }
+
+#if (WS2812_ENCODE_TABLE == WS2812_ENCODE_TABLE_FULL)
+    for(i=0; i<256; i++)
+    {
+        uint32_t symbol = 0;
+
+        for(uint32_t iBit = 0x80; iBit != 0; iBit >>= 1)
+        {
+            symbol = (symbol << _iBitSPIClocks) | ((i & iBit) ? symbol1 : symbol0);
+        }
+
+        _rgSymbols[i] = __builtin_bswap32(symbol << (32 - (8 * _iBitSPIClocks)));
+        if(_fInvert)
+        {
+            _rgSymbols[i] = ~_rgSymbols[i];
+        }
+    }
+#else
+    for(i=0; i<16; i++)
+    {
+        uint32_t symbol = 0;
+
+        for(uint32_t iBit = 0x8; iBit != 0; iBit >>= 1)
+        {
+            symbol = (symbol << _iBitSPIClocks) | ((i & iBit) ? symbol1 : symbol0);
+        }
+
+        if(_fInvert)
+        {
+            symbol = ~symbol & ((1 << (4 * _iBitSPIClocks)) - 1);
+        }
+
+        _rgSymbols[i] = (uint16_t) symbol;
+    }
+#endif
+}
+
+/***    uint32_t LookupSymbol<cbColor>(rgSymbols, uint8_t color)
+ *
+ *    Parameters:
+ *          rgSymbols:  The symbol table built by buildSymbols()
+ *
+ *          color:      a value between 0 - 255, it is the 
+ *                      intensity of a single color
+ *
+ *    Return Values:
+ *          The cbColor bytes of SPI pattern for color in the low
+ *          bytes of the word, in pattern buffer order.
+ *
+ * ------------------------------------------------------------ */
+#if (WS2812_ENCODE_TABLE == WS2812_ENCODE_TABLE_FULL)
+template<uint32_t cbColor>
+static inline uint32_t __attribute__((always_inline)) LookupSymbol(const uint32_t * rgSymbols, uint8_t color)
+{
+    return(rgSymbols[color]);
+}
+#else
+template<uint32_t cbColor>
+static inline uint32_t __attribute__((always_inline)) LookupSymbol(const uint16_t * rgSymbols, uint8_t color)
+{
+    uint32_t symbol = (((uint32_t) rgSymbols[color >> 4]) << (4 * cbColor)) | rgSymbols[color & 0xF];
+
+    return(__builtin_bswap32(symbol << (32 - (8 * cbColor))));
+}
+#endif
+
+/***    void WS2812::encodeTable<cbColor, fLUT>(uint8_t * pDst, const GRB * pGRB, uint32_t cDevices)
+ *
+ *    Parameters:
+ *          pDst:       Where in the pattern buffer the first device goes
+ *
+ *          pGRB:       The first device to convert
+ *
+ *          cDevices:   How many devices to convert
+ *
+ *    Return Values:
+ *          None
+ *
+ *    Description:
+ *
+ *      A private method to convert devices into the pattern buffer
+ *      with the symbol table. cbColor is the bit width in SPI clocks,
+ *      which is also the number of pattern bytes per color. With fLUT
+ *      each color goes through the color tables first.
+ *
+ * ------------------------------------------------------------ */
+template<uint32_t cbColor, bool fLUT>
+void WS2812::encodeTable(uint8_t * pDst, const GRB * pGRB, uint32_t cDevices)
+{
+    // a 4 clock symbol is a word, one store if the run is on a word boundary
+    if(cbColor == 4 && ((uintptr_t) pDst & 3) == 0)
+    {
+        Words words(pDst, _fMode32);
+        encodeRun<cbColor, fLUT>(words, pGRB, cDevices);
+    }
+    else
+    {
+        Packer packer(pDst, _fMode32);
+        encodeRun<cbColor, fLUT>(packer, pGRB, cDevices);
+    }
+}
+
+template<uint32_t cbColor, bool fLUT, class TOut>
+void WS2812::encodeRun(TOut& out, const GRB * pGRB, uint32_t cDevices)
+{
+    const uint8_t * pLUT = _pColorLUT;
+
+    for(; cDevices > 0; cDevices--, pGRB++)
+    {
+        uint32_t green  = pGRB->green;
+        uint32_t red    = pGRB->red;
+        uint32_t blue   = pGRB->blue;
+
+        if(fLUT)
+        {
+            green   = pLUT[(offsetof(GRB, green) << 8) + green];
+            red     = pLUT[(offsetof(GRB, red) << 8) + red];
+            blue    = pLUT[(offsetof(GRB, blue) << 8) + blue];
         }
 
-        // since the buffer is init with zeros
-        // just skip forward to fill out the rest of the symbol with zeros.
-        _iBit   += _iBitSPIClocks - _iBit0SPIClocksHigh;
-        _iByte  += _iBit / 8;
-        _iBit   %= 8;
+        out.put(LookupSymbol<cbColor>(_rgSymbols, green), cbColor);
+        out.put(LookupSymbol<cbColor>(_rgSymbols, red), cbColor);
+        out.put(LookupSymbol<cbColor>(_rgSymbols, blue), cbColor);
+    }
+    out.flush();
+}
+
+/***    void WS2812::encodeSymbols(WS2812Core * pWS2812, uint8_t * pDst, const void * pPixels, uint32_t iDevice, uint32_t cDevices)
+ *
+ *    Parameters:
+ *          pWS2812:    The WS2812 object doing the converting
+ *
+ *          pDst:       Where in the pattern buffer the first device goes
+ *
+ *          pPixels:    The first device to convert, a GRB
+ *
+ *          iDevice:    Where the first device is on the chain, not needed here
+ *
+ *          cDevices:   How many devices to convert
+ *
+ *    Return Values:
+ *          None
+ *
+ *    Description:
+ *
+ *      A private method to convert a run of devices into the pattern buffer.
+ *      The bit width and the color tables only pick the encoder once per run, 
+ *      the loops themselves are built for a fixed bit width.
+ *
+ * ------------------------------------------------------------ */
+void WS2812::encodeSymbols(WS2812Core * pWS2812, uint8_t * pDst, const void * pPixels, uint32_t, uint32_t cDevices)
+{
+    WS2812 *    pThis   = (WS2812 *) pWS2812;
+    const GRB * pGRB    = (const GRB *) pPixels;
+    bool        fLUT    = (pThis->_pColorLUT != NULL);
+
+    // begin() needs 3 clocks at least, a 0 high, a longer 1 high and a low
+    switch(pThis->_iBitSPIClocks)
+    {
+        case 3:
+            fLUT ? pThis->encodeTable<3, true>(pDst, pGRB, cDevices) : pThis->encodeTable<3, false>(pDst, pGRB, cDevices);
+            break;
+
+        case 4:
+            fLUT ? pThis->encodeTable<4, true>(pDst, pGRB, cDevices) : pThis->encodeTable<4, false>(pDst, pGRB, cDevices);
+            break;
+
+#if (WS2812_MAX_SPI_CLOCKS_PER_LED_BIT > 4)
+        // too wide for the table, go a bit at a time
+        default:
+            pThis->encodeBits(pDst, pGRB, cDevices);
+            break;
+#endif
     }
 }
 
+#if (WS2812_MAX_SPI_CLOCKS_PER_LED_BIT > 4)
+/***    void WS2812::encodeBits(uint8_t * pDst, const GRB * pGRB, uint32_t cDevices)
+ *
+ *    Parameters:
+ *          pDst:       Where in the pattern buffer the first device goes
+ *
+ *          pGRB:       The first device to convert
+ *
+ *          cDevices:   How many devices to convert
+ *
+ *    Return Values:
+ *          None
+ *
+ *    Description:
+ *
+ *      A private method to convert devices into the pattern buffer
+ *      a bit at a time, for bit widths too wide for the symbol table.
+ *      begin() only takes them if WS2812_MAX_SPI_CLOCKS_PER_LED_BIT is
+ *      raised past 4, so only then is this built.
+ *      The symbols of the bits are shifted into a 64 bit accumulator,
+ *      first SPI clock first, and each 32 clocks go out as a word, 
+ *      so no byte of the pattern buffer is read back or stored twice.
+ *
+ * ------------------------------------------------------------ */
+void WS2812::encodeBits(uint8_t * pDst, const GRB * pGRB, uint32_t cDevices)
+{
+    uint32_t    symbol1 = ((1ul << _iBit1SPIClocksHigh) - 1) << (_iBitSPIClocks - _iBit1SPIClocksHigh);
+    uint32_t    symbol0 = ((1ul << _iBit0SPIClocksHigh) - 1) << (_iBitSPIClocks - _iBit0SPIClocksHigh);
+    uint32_t    invert  = _fInvert ? 0xFFFFFFFF : 0;
+    uint64_t    bits    = 0;
+    uint32_t    cBits   = 0;
+    Packer      packer(pDst, _fMode32);
+
+    for(; cDevices > 0; cDevices--, pGRB++)
+    {
+        uint8_t rgColors[3] = { pGRB->green, pGRB->red, pGRB->blue };
+
+        for(uint32_t iColor = 0; iColor < sizeof(rgColors); iColor++)
+        {
+            uint32_t color = rgColors[iColor];
+
+            if(_pColorLUT != NULL)
+            {
+                color = _pColorLUT[(iColor << 8) + color];
+            }
+
+            for(uint32_t iBit = 0x80; iBit != 0; iBit >>= 1)
+            {
+                bits   = (bits << _iBitSPIClocks) | ((color & iBit) ? symbol1 : symbol0);
+                cBits += _iBitSPIClocks;
+
+                if(cBits >= 32)
+                {
+                    cBits -= 32;
+                    packer.put(__builtin_bswap32((uint32_t) (bits >> cBits)) ^ invert, 4);
+                }
+            }
+        }
+    }
+
+    // a color is a whole number of bytes, so this is too
+    if(cBits > 0)
+    {
+        packer.put(__builtin_bswap32(((uint32_t) bits) << (32 - cBits)) ^ invert, cBits / 8);
+    }
+    packer.flush();
+}
+#endif
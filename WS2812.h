@@ -48,9 +48,10 @@
 /*  chipKIT Max32 Dout pin 43 or (51 with JP4 in master);               */
 /*          unusable pins 29,50,52                                      */
 /*                                                                      */
-/*  WARNING: currently this code assumes SPI2. Of the chipKIT boards    */
-/*  this works on (WF32/Max32), the standard Arduino SPI just happens   */
-/*  to always be SPI2, but this is NOT generalized code!                */
+/*  By default this uses SPI2 and DMA channels 0 and 1. Of the chipKIT  */
+/*  boards this works on, the standard Arduino SPI just happens to      */
+/*  be SPI2. begin() can pick another SPI and DMA channel pair, so      */
+/*  several chains can each refresh on their own SPI at the same time.  */
 /*                                                                      */
 /*  The spec says that Dout Vih = .7Vdd and Vdd = 6v-7v However...      */
 /*  it seems to work with Vdd == 4.5v -> 5v and Vih == 3.3              */
@@ -60,7 +61,11 @@
 /*  you can specify fInvert=true on begin() to invert the 3.3v signal   */
 /*                                                                      */
 /************************************************************************/
-#include <WProgram.h>
+#ifndef _WS2812_H
+#define _WS2812_H
+
+#include <WS2812Driver.h>
+#include <stddef.h>
 
 /* CPUs with _DMAC defined have DMA. */
 #if !defined(_DMAC)
@@ -94,7 +99,7 @@
  */
 
 /* This is the number of SPI clocks per 1 or 0 being sent out to the LED. You MUST
- * change this value if you change WS2812_SPI_CLOCK_RATE in CoreTimer.c to maintain
+ * change this value if you change WS2812_SPI_CLOCK_RATE in WS2812Driver.h to maintain
  * the necessary timing per 1 or 0. With a 3MHz SPI clock, we use a 1 high time of 
  * 1 SPI clock, a 0 high time of 2 SPI clocks, and a total bit time of 4 SPI clocks.
  *
@@ -107,14 +112,78 @@
 /* The number of bytes needed in the SPI DMA buffer to represent one LED worth of 
  * brightness values.*/
 #define WS2812_MAX_SPI_BYTES_PER_LED      (WS2812_MAX_SPI_CLOCKS_PER_LED_BIT * 3)    
-/* A macro to help the user in their sketch define the size of the SPI DMA buffer */
+/* A macro to help the user in their sketch define the size of the SPI DMA buffer.
+ * When double buffering each of the two buffers must be this size. */
 #define CBWS2812PATBUF(__cDevices)        (WS2812_MAX_SPI_BYTES_PER_LED * __cDevices)
+/* The same for devices of __cColors colors, and for a WS2812T pixel format 
+ * (a typedef of WS2812Format), say CBWS2812PATBUFFMT(60, WS2812FormatGRBW) for RGBW */
+#define CBWS2812PATBUFCOLORS(__cDevices, __cColors) (WS2812_MAX_SPI_CLOCKS_PER_LED_BIT * (__cColors) * (__cDevices))
+#define CBWS2812PATBUFFMT(__cDevices, __TFormat)    CBWS2812PATBUFCOLORS(__cDevices, __TFormat::cColors)
+/* The same for a bit width of __cClocks SPI clocks, what WS2812Core::pickTiming()
+ * picks for the TIMING given to begin(), say CBWS2812PATBUFCLKS(60, 3) for
+ * a WS2812B; 9 bytes a device instead of 12 */
+#define CBWS2812PATBUFCLKS(__cDevices, __cClocks)   ((__cClocks) * 3 * (__cDevices))
+/* The size of the ring beginStream() streams through, two halves of __cDevices each.
+ * Any chain length streams through the same ring; bigger halves give the refill
+ * more time. */
+#define CBWS2812RING(__cDevices)          (2 * CBWS2812PATBUF(__cDevices))
+#define CBWS2812RINGFMT(__cDevices, __TFormat)      (2 * CBWS2812PATBUFFMT(__cDevices, __TFormat))
+/* The size of the tables setColorTables() needs, a 256 byte table per byte of __TPixel */
+#define CBWS2812COLORLUT(__TPixel)        (256 * sizeof(__TPixel))
+/* Puts a pattern buffer or ring on a word boundary, so the encoders can store
+ * whole words: uint8_t rgbPatternBuffer[CBWS2812PATBUF(60)] WS2812_ALIGNED;
+ * begin() moves an unaligned buffer up to the next word if there are 
+ * CBWS2812ALIGN() bytes to spare. */
+#define WS2812_ALIGNED                    __attribute__((aligned(4)))
+#define CBWS2812ALIGN(__cb)               ((__cb) + 3)
+/* The size of the symbols setPalette() caches, a device worth for each of __cColors palette colors */
+#define CBWS2812PALETTE(__cColors)        CBWS2812PATBUF(__cColors)
+#define CBWS2812PALETTEFMT(__cColors, __TFormat)    CBWS2812PATBUFFMT(__cColors, __TFormat)
+/* The size of the ring setTrace() needs for __cEvents events, a power of 2 */
+#define CBWS2812TRACE(__cEvents)          ((__cEvents) * sizeof(WS2812EVENT))
+/* The size of the dither state setDither() needs, a byte per color of each device */
+#define CBWS2812DITHER(__cDevices, __TFormat)       ((__cDevices) * __TFormat::cColors)
 /* Default total, 1 high and 0 high clock counts. Can be over-ridden on begin() */
 #define WS2812_DEFAULT_BIT_WIDTH_CLKS      4  // 1332nS  
 #define WS2812_DEFAULT_BIT_0_HIGH_CLKS     1  //  333nS
 #define WS2812_DEFAULT_BIT_1_HIGH_CLKS     2  //  666nS
 
-class WS2812 {
+/* begin() builds a lookup table that maps a color byte to its SPI symbol pattern
+ * so that a whole color byte is encoded with one lookup and one store instead of
+ * one SPI bit at a time. The table is only used for bit widths of up to 4 SPI clocks,
+ * where a color byte fits in a 32 bit word; wider bit widths use the bit at a time encoder.
+ *
+ * WS2812_ENCODE_TABLE_FULL is a 256 entry table, 1024 bytes of RAM per WS2812 object.
+ * WS2812_ENCODE_TABLE_NIBBLE is a 16 entry table, 32 bytes of RAM per WS2812 object,
+ * at the cost of 2 lookups and a little shifting per color byte. The nibble table is
+ * the default on the Fubarino Mini, define WS2812_ENCODE_TABLE here to pick one yourself.
+ *
+ * WS2812T, and WS2812 with the default bit timings, use a compile time table in flash instead.
+ */
+#define WS2812_ENCODE_TABLE_FULL          256
+#define WS2812_ENCODE_TABLE_NIBBLE        16
+#if !defined(WS2812_ENCODE_TABLE)
+    #if defined(_BOARD_FUBARINO_MINI_)
+        #define WS2812_ENCODE_TABLE       WS2812_ENCODE_TABLE_NIBBLE
+    #else
+        #define WS2812_ENCODE_TABLE       WS2812_ENCODE_TABLE_FULL
+    #endif
+#endif
+
+/* How many separate runs of devices markDirty() keeps; past this the 2
+ * closest are merged, and the devices between them converted too. */
+#if !defined(WS2812_DIRTY_RANGES)
+    #define WS2812_DIRTY_RANGES           4
+#endif
+
+/* A list of indexes, used to build the compile time symbol tables of WS2812T */
+template<uint32_t... i> struct WS2812Indices {};
+template<uint32_t c, uint32_t... i> struct WS2812MakeIndices : WS2812MakeIndices<c - 1, c - 1, i...> {};
+template<uint32_t... i> struct WS2812MakeIndices<0, i...> { typedef WS2812Indices<i...> type; };
+
+/* The update state machine shared by WS2812 and WS2812T. The only
+ * thing the two differ in is how a device is converted into SPI symbols. */
+class WS2812Core {
    
 public:
 
@@ -125,20 +194,263 @@ public:
         uint8_t blue;
     } GRB;
 
-    WS2812();
-    ~WS2812();
+    /* Pixels for the other formats of WS2812T, see WS2812Format */
+    typedef struct _RGB
+    {
+        uint8_t red;
+        uint8_t green;
+        uint8_t blue;
+    } RGB;
+
+    typedef struct _RGBW
+    {
+        uint8_t red;
+        uint8_t green;
+        uint8_t blue;
+        uint8_t white;
+    } RGBW;
+
+    /* 16 bit per color pixels, dithered down to the 8 bits sent, see setDither() */
+    typedef struct _GRB16
+    {
+        uint16_t green;
+        uint16_t red;
+        uint16_t blue;
+    } GRB16;
+
+    typedef struct _RGBW16
+    {
+        uint16_t red;
+        uint16_t green;
+        uint16_t blue;
+        uint16_t white;
+    } RGBW16;
+
+    /* The limits of an LED time in nS */
+    typedef struct _RANGE
+    {
+        uint32_t nsMin;
+        uint32_t nsMax;
+    } RANGE;
+
+    /* The limits a bit must be in, see the times above */
+    typedef struct _TIMING
+    {
+        RANGE   t0High;
+        RANGE   t0Low;
+        RANGE   t1High;
+        RANGE   t1Low;
+        RANGE   period;
+        uint32_t nsReset;       // a low this long latches the chain
+    } TIMING;
+
+    static const TIMING timingMeasured;     // what WS2812s have been measured to accept
+    static const TIMING timingWS2812;       // the WS2812 / WS2812S data sheet
+    static const TIMING timingWS2812B;      // the WS2812B data sheet
+
+    /* An SPI clock and the symbols in SPI clocks that meet a TIMING */
+    typedef struct _SPITIMING
+    {
+        uint32_t spiClockRate;
+        uint16_t cBitWidth;
+        uint16_t cBit1High;
+        uint16_t cBit0High;
+    } SPITIMING;
+
+    static bool pickTiming(const TIMING& timing, uint32_t pbClock, SPITIMING * pSPITiming);
+    uint32_t spiClockRate(void) { return(_spiClockRate); }
+    bool mode32(void)           { return(_fMode32); }
+
+    /* Called from the core timer service when an update is on the chain */
+    typedef void (* PFNFRAMEDONE)(WS2812Core * pWS2812, void * pContext);
+
+    bool updateLEDs(GRB rgGRB[], uint32_t cPass = 5)            { return(updatePixels(rgGRB, cPass)); }
+    bool updateDirtyLEDs(GRB rgGRB[], uint32_t cPass = 5)       { return(updateDirtyPixels(rgGRB, cPass)); }
+    bool updateLEDsFor(GRB rgGRB[], uint32_t usBudget)          { return(updatePixelsFor(rgGRB, usBudget)); }
+    bool updateDirtyLEDsFor(GRB rgGRB[], uint32_t usBudget)     { return(updateDirtyPixelsFor(rgGRB, usBudget)); }
+
+    /* Indexed color, each device is an index into the palette given to setPalette() */
+    bool updateIndexedLEDs(const uint8_t rgIndex[], uint32_t cPass = 5)         { return(updatePixels(rgIndex, cPass, true)); }
+    bool updateDirtyIndexedLEDs(const uint8_t rgIndex[], uint32_t cPass = 5)    { return(updateDirtyPixels(rgIndex, cPass, true)); }
+    bool updateIndexedLEDsFor(const uint8_t rgIndex[], uint32_t usBudget)       { return(updatePixelsFor(rgIndex, usBudget, true)); }
+    bool updateDirtyIndexedLEDsFor(const uint8_t rgIndex[], uint32_t usBudget)  { return(updateDirtyPixelsFor(rgIndex, usBudget, true)); }
+    bool setPalette(const GRB rgPalette[], uint32_t cPalette, uint8_t * pSymbols, uint32_t cbSymbols) { return(setPalettePixels(rgPalette, cPalette, pSymbols, cbSymbols)); }
+
+    /* Straight into the pattern buffer, a color or a pattern converted once and copied */
+    bool fillLEDs(const GRB& grb, uint32_t iDevice = 0, uint32_t cDevices = 0xFFFFFFFF)                           { return(fillPixels(&grb, 1, iDevice, cDevices)); }
+    bool repeatLEDs(const GRB rgPattern[], uint32_t cPattern, uint32_t iDevice = 0, uint32_t cDevices = 0xFFFFFFFF) { return(fillPixels(rgPattern, cPattern, iDevice, cDevices)); }
+    bool scrollLEDs(int32_t cShift)                                                                                 { return(scrollPixels(cShift, NULL)); }
+    bool scrollLEDs(int32_t cShift, const GRB rgGRB[])                                                              { return(scrollPixels(cShift, rgGRB)); }
+
+    uint32_t devicesLeft(void);
+    void markDirty(uint32_t iDevice, uint32_t cDevices = 1);
+    void abortUpdate(void);
+    void end(void);
+
+    bool setDriver(WS2812Driver * pDriver);
+    WS2812Driver * driver(void) { return(_pDriver); }
+
+    bool setRefreshPeriod(uint32_t usRefresh);
+    void setPushOnCommit(bool fPush);
+    void setEarlyStart(uint32_t cLead);
+    bool setMode32(bool fMode32);
+
+    bool setColorTables(uint8_t * pTables, uint32_t cbTables);
+    void setBrightness(uint8_t brightness);
+    void setColorCorrection(const uint8_t rgCorrection[], uint32_t cCorrection);
+    void setGamma(float gamma);
+
+    bool setDither(uint8_t * pError, uint32_t cbError);
+
+    void setFrameDone(PFNFRAMEDONE pfnFrameDone, void * pContext = NULL);
+    bool isBusy(void);
+    bool waitIdle(uint32_t msTimeout = 1000);
+
+    /* Refresh and update counters, see WS2812STATS in WS2812Driver.h */
+    typedef WS2812STATS STATS;
+    void getStats(STATS * pStats);
+    void clearStats(void);
+
+    /* A ring of timed events from the update state machine and the refreshes */
+    typedef void (* PFNTRACEWRITE)(const uint8_t * pb, uint32_t cb, void * pContext);
+    bool setTrace(uint8_t * pTrace, uint32_t cbTrace);
+    uint32_t dumpTrace(PFNTRACEWRITE pfnWrite, void * pContext = NULL);
+
+protected:
+
+    template<uint16_t, uint16_t, uint16_t, class> friend class WS2812Encoder;
+
+    typedef void (* PFNENCODE)(WS2812Core * pWS2812, uint8_t * pDst, const void * pPixels, uint32_t iDevice, uint32_t cDevices);
+
+    WS2812Core();
+    ~WS2812Core();
 
     bool begin(
         uint32_t cDevices, 
         uint8_t * pPatternBuffer, 
+        uint8_t * pPatternBuffer2, 
         uint32_t cbPatternBuffer, 
-        bool fInvert = false,
-        uint16_t cBitWidth = WS2812_DEFAULT_BIT_WIDTH_CLKS, 
-        uint16_t cBit1High = WS2812_DEFAULT_BIT_1_HIGH_CLKS, 
-        uint16_t cBit0High = WS2812_DEFAULT_BIT_0_HIGH_CLKS);
-    bool updateLEDs(GRB rgGRB[], uint32_t cPass = 5);
-    void abortUpdate(void);
-    void end(void);
+        bool fInvert,
+        uint16_t cBitWidth, 
+        uint16_t cBit1High, 
+        uint16_t cBit0High,
+        uint8_t iSPI,
+        uint8_t iDMA,
+        PFNENCODE pfnEncode,
+        bool fStream = false,
+        uint32_t cColors = 3,
+        uint32_t cbPixel = sizeof(GRB),
+        uint32_t spiClockRate = WS2812_SPI_CLOCK_RATE);
+
+    /* The update state machine behind updateLEDs() and friends, for any pixel */
+    bool updatePixels(const void * rgPixels, uint32_t cPass, bool fIndexed = false);
+    bool updateDirtyPixels(const void * rgPixels, uint32_t cPass, bool fIndexed = false);
+    bool updatePixelsFor(const void * rgPixels, uint32_t usBudget, bool fIndexed = false);
+    bool updateDirtyPixelsFor(const void * rgPixels, uint32_t usBudget, bool fIndexed = false);
+    bool setPalettePixels(const void * rgPalette, uint32_t cPalette, uint8_t * pSymbols, uint32_t cbSymbols);
+    bool fillPixels(const void * rgPattern, uint32_t cPattern, uint32_t iDevice, uint32_t cDevices);
+    bool scrollPixels(int32_t cShift, const void * rgPixels);
+
+    /* The pattern buffer seen as words, for the encoders' word stores */
+    typedef uint32_t __attribute__((__may_alias__)) WORD;
+
+    /* Puts the symbols of a run of devices into the pattern buffer a 32 bit 
+     * word at a time, whatever size a symbol is. The PIC32 is little endian,
+     * so the symbols are joined low byte first. A run can start and end part
+     * way into a word, 9 byte devices do; the bytes before the first whole 
+     * word and after the last one are stored one at a time, so nothing 
+     * outside the run is read or written. With fMode32 the SPI shifts
+     * each word out MSb first, so the bytes of every word are reversed. */
+    class Packer
+    {
+    public:
+
+        Packer(uint8_t * pb, bool fMode32) : 
+            _pw((WORD *) (pb - ((uintptr_t) pb & 3))), _acc(0), _cb((uintptr_t) pb & 3), _ibFirst(_cb), _fMode32(fMode32) {}
+
+        /* the low cbSymbol bytes of symbol are the next bytes of the run */
+        inline void __attribute__((always_inline)) put(uint32_t symbol, uint32_t cbSymbol)
+        {
+            if(cbSymbol < 4)
+            {
+                symbol &= (1ul << (8 * cbSymbol)) - 1;
+            }
+
+            _acc |= ((uint64_t) symbol) << (8 * _cb);
+            _cb  += cbSymbol;
+
+            if(_cb >= 4)
+            {
+                if(_ibFirst == 0)
+                {
+                    *_pw = _fMode32 ? __builtin_bswap32((uint32_t) _acc) : (uint32_t) _acc;
+                }
+                else
+                {
+                    storeBytes(4);
+                }
+                _pw++;
+                _acc >>= 32;
+                _cb  -= 4;
+            }
+        }
+
+        /* stores what is left at the end of the run */
+        inline void flush(void)
+        {
+            storeBytes(_cb);
+        }
+
+    private:
+
+        WORD *      _pw;        // the word being filled
+        uint64_t    _acc;       // its bytes so far, and any that spill into the next
+        uint32_t    _cb;
+        uint32_t    _ibFirst;   // in the first word, the run starts here
+        bool        _fMode32;
+
+        void storeBytes(uint32_t ibEnd)
+        {
+            for(uint32_t ib = _ibFirst; ib < ibEnd; ib++)
+            {
+                ((uint8_t *) _pw)[_fMode32 ? (ib ^ 3) : ib] = (uint8_t) (_acc >> (8 * ib));
+            }
+            _ibFirst = 0;
+        }
+    };
+
+    /* The same for 4 byte symbols into a word aligned run, where every symbol is one word store */
+    class Words
+    {
+    public:
+
+        Words(uint8_t * pb, bool fMode32) : _pw((WORD *) pb), _fMode32(fMode32) {}
+
+        inline void __attribute__((always_inline)) put(uint32_t symbol, uint32_t)
+        {
+            *_pw++ = _fMode32 ? __builtin_bswap32(symbol) : symbol;
+        }
+
+        inline void flush(void)
+        {
+        }
+
+    private:
+
+        WORD *      _pw;
+        bool        _fMode32;
+    };
+
+    bool            _fInvert;               // The encoder writes inverted symbols
+    bool            _fMode32;               // and in word order, kept over begin() and end(), see setMode32()
+    uint8_t *       _pColorLUT;             // Per pixel byte, what each color value is sent as, or NULL
+    uint8_t *       _pDither;               // Per color of each device, what the last refresh left over, or NULL
+    uint8_t *       _pPatternBuffer;        // The pattern buffer being updated
+    uint8_t *       _pPatternBufferFront;   // When double buffered, the pattern buffer being refreshed
+    uint8_t         _iBitSPIClocks;         // Total number of SPI clocks for a 1 or a 0 bit
+    uint8_t         _iBit1SPIClocksHigh;    // Number of SPI clocks for a 1 bit high period
+    uint8_t         _iBit0SPIClocksHigh;    // Number of SPI clocks for a 0 bit high period
+    uint32_t        _cbDevice;              // Number of pattern buffer bytes for one device
 
 private:
 
@@ -147,27 +459,466 @@ private:
         INIT,
         WAITUPD,
         CONVGRB,
-        INVERT,
         ENDUPD
     } UST;
 
+    /* A run of devices, iFirst up to but not including iEnd */
+    typedef struct _DEVRANGE
+    {
+        uint32_t    iFirst;
+        uint32_t    iEnd;
+    } DEVRANGE;
+
+    /* Updates that work on the pattern buffer rather than convert pixels */
+    typedef enum
+    {
+        EDITNONE,
+        EDITFILL,
+        EDITSCROLL
+    } EDIT;
+
     bool            _fInit;
-    bool            _fInvert;
     uint32_t        _cDevices;
     uint32_t        _iNextDevice;
-    uint8_t *       _pPatternBuffer;
+    uint32_t        _iFirstDevice;          // The devices the update in progress converts
+    uint32_t        _iEndDevice;
+    uint32_t        _tDevice;               // Core timer ticks to convert a device, times 16, as last measured
+    DEVRANGE        _rgDirty[WS2812_DIRTY_RANGES + 1];  // The devices marked dirty for the next update, in order and apart; one spare to merge
+    uint32_t        _cDirty;
+    DEVRANGE        _rgUpdate[WS2812_DIRTY_RANGES];     // The dirty devices the update in progress converts, _iFirstDevice to _iEndDevice is _rgUpdate[_iUpdate]
+    uint32_t        _cUpdate;
+    uint32_t        _iUpdate;
+    DEVRANGE        _rgStale[WS2812_DIRTY_RANGES];      // When double buffered, the devices the back pattern buffer is behind on
+    uint32_t        _cStale;
     uint32_t        _cbPatternBuffer;
-    uint32_t        _iByte;
-    uint32_t        _iBit;
-    GRB *           _pGRB;
+    uint32_t        _spiClockRate;          // what the bit widths are counted in
+    const uint8_t * _pPixels;               // The pixels of the update in progress
+    bool            _fIndexed;              // and if they are palette indexes
+    EDIT            _edit;                  // or what fillLEDs(), repeatLEDs() or scrollLEDs() is doing
+    uint32_t        _cFill;                 // how many pixels the fill pattern is
+    int32_t         _cShift;                // how many devices to scroll towards the end of the chain
+    uint32_t        _cbPixel;
+    const uint8_t * _pPalette;              // The palette colors, each cached as the symbols of a device
+    uint32_t        _cPalette;
+    uint8_t *       _pPaletteSymbols;
     UST             _updateState;
-    uint8_t         _iBitSPIClocks;         // Total number of SPI clocks for a 1 or a 0 bit
-    uint8_t         _iBit1SPIClocksHigh;    // Number of SPI clocks for a 1 bit high period
-    uint8_t         _iBit0SPIClocksHigh;    // Number of SPI clocks for a 0 bit high period
+    PFNENCODE       _pfnEncode;
+    uint32_t        _usRefresh;             // kept over begin() and end()
+    bool            _fPush;
+    uint32_t        _cEarly;                // devices converted before the refresh may start, 0 for not until done; kept over begin() and end()
+    bool            _fEarly;                // the update in progress has let the refresh start
+    bool            _fCaught;               // and the DMA has caught up with it
+    uint8_t         _brightness;            // kept over begin() and end(), see buildColorTables()
+    uint8_t         _rgCorrection[4];
+    float           _gamma;
+    PFNFRAMEDONE    _pfnFrameDone;
+    void *          _pFrameDoneContext;
+    bool            _fStream;               // refreshes are encoded from _pGRBStream as they go out
+    const uint8_t * volatile _pStreamPixels;
+    volatile bool   _fStreamIndexed;
+    uint32_t        _cFrames;               // The counters of getStats() kept here
+    uint32_t        _cCaught;
+    uint32_t        _tEncodeFrame;          // Core timer ticks spent converting the update in progress
+    uint32_t        _tEncodeLast;
+    uint32_t        _tEncodeMax;
+    uint64_t        _tEncode;
+    WS2812TRACE     _trace;                 // kept over begin() and end(), see setTrace()
+    bool            _fRefused;              // the update in progress has traced the pattern buffer being busy
+    WS2812Driver *  _pDriver;
+    WS2812PlatformDriver _platformDriver;
 
     void init(void);
-    void applyGRB(GRB& grb);
-    void applyColor(uint8_t color);
-    void applyBit(uint32_t fOne);
+    static void frameDone(void * pContext);
+    static void fillStream(void * pContext, uint8_t * pb, uint32_t ib, uint32_t cb);
+    void encode(uint8_t * pDst, const uint8_t * rgPixels, bool fIndexed, uint32_t iDevice, uint32_t cDevices);
+    template<uint32_t cbDevice> void encodeIndexes(uint8_t * pDst, const uint8_t * pIndex, uint32_t cDevices);
+    void expandPalette(void);
+    void encodeRepeat(void);
+    void scrollPatternBuffer(void);
+    void rotateDevices(uint32_t cLeft);
+    void reverseDevices(uint32_t iFirst, uint32_t iEnd);
+    void buildColorTables(void);
+    void endEncode(void);
+    void updateRefresh(void);
+    void setUpdateState(UST updateState);
+
+    inline void trace(uint32_t event, uint32_t arg8, uint32_t arg)
+    {
+        if(_trace.pEvents != NULL)
+        {
+            TraceWS2812(&_trace, _pDriver->ticks(), event, arg8, arg);
+        }
+    }
+};
+
+/* The SPI symbols for a fixed bit timing, worked out at compile time.
+ * A symbol is the pattern of one color byte, in the order the bytes go into
+ * the pattern buffer; the PIC32 is little endian so the first SPI byte is the low byte. */
+template<uint16_t cBitWidth, uint16_t cBit1High, uint16_t cBit0High>
+struct WS2812Symbols
+{
+    static constexpr uint32_t symbol1 = ((1ul << cBit1High) - 1) << (cBitWidth - cBit1High);
+    static constexpr uint32_t symbol0 = ((1ul << cBit0High) - 1) << (cBitWidth - cBit0High);
+
+    /* the last cBits of color, first SPI clock in the MSb */
+    static constexpr uint32_t ofBits(uint32_t color, uint32_t cBits)
+    {
+        return(cBits == 0 ? 0 : ((ofBits(color >> 1, cBits - 1) << cBitWidth) | ((color & 1) ? symbol1 : symbol0)));
+    }
+
+    static constexpr uint32_t swap(uint32_t symbol)
+    {
+        return((symbol >> 24) | ((symbol >> 8) & 0xFF00) | ((symbol << 8) & 0xFF0000) | (symbol << 24));
+    }
+
+    static constexpr uint32_t ofByte(uint32_t color)
+    {
+        return(swap(ofBits(color, 8) << (32 - (8 * cBitWidth))));
+    }
+};
+
+template<uint16_t cBitWidth, uint16_t cBit1High, uint16_t cBit0High, class TIndices> struct WS2812SymbolTable;
+
+template<uint16_t cBitWidth, uint16_t cBit1High, uint16_t cBit0High, uint32_t... i>
+struct WS2812SymbolTable<cBitWidth, cBit1High, cBit0High, WS2812Indices<i...> >
+{
+    static constexpr uint32_t rgSymbols[sizeof...(i)] = { WS2812Symbols<cBitWidth, cBit1High, cBit0High>::ofByte(i)... };
+};
+
+template<uint16_t cBitWidth, uint16_t cBit1High, uint16_t cBit0High, uint32_t... i>
+constexpr uint32_t WS2812SymbolTable<cBitWidth, cBit1High, cBit0High, WS2812Indices<i...> >::rgSymbols[sizeof...(i)];
+
+/* A pixel format for WS2812T: the pixel the application keeps, and the 
+ * offsets in it of the colors in the order the chain wants them sent. The 
+ * encoder picks the colors out of each pixel in that order, so the pixels
+ * never have to be reordered, and a device is cColors symbols long. */
+template<typename TPixel, uint8_t... iColors>
+struct WS2812Format
+{
+    typedef TPixel PIXEL;
+    typedef uint8_t CHANNEL;
+    static constexpr uint32_t cColors = sizeof...(iColors);
+    static constexpr uint8_t rgiColors[sizeof...(iColors)] = { iColors... };
+};
+
+template<typename TPixel, uint8_t... iColors>
+constexpr uint8_t WS2812Format<TPixel, iColors...>::rgiColors[sizeof...(iColors)];
+
+/* The same for pixels of 16 bit colors, the offsets are still in bytes. 
+ * Each color is sent as its high byte; with setDither() the low byte 
+ * is carried from refresh to refresh so the light averages out to all 16. */
+template<typename TPixel, uint8_t... iColors>
+struct WS2812Format16
+{
+    typedef TPixel PIXEL;
+    typedef uint16_t CHANNEL;
+    static constexpr uint32_t cColors = sizeof...(iColors);
+    static constexpr uint8_t rgiColors[sizeof...(iColors)] = { iColors... };
+};
+
+template<typename TPixel, uint8_t... iColors>
+constexpr uint8_t WS2812Format16<TPixel, iColors...>::rgiColors[sizeof...(iColors)];
+
+/* Named for the order on the wire. WS2812 and WS2812B are GRB, the 
+ * default; SK6812 RGBW is GRBW. Other orders are one typedef away. */
+typedef WS2812Format<WS2812Core::GRB,  offsetof(WS2812Core::GRB, green), offsetof(WS2812Core::GRB, red), offsetof(WS2812Core::GRB, blue)> WS2812FormatGRB;
+typedef WS2812Format<WS2812Core::RGB,  offsetof(WS2812Core::RGB, red), offsetof(WS2812Core::RGB, green), offsetof(WS2812Core::RGB, blue)> WS2812FormatRGB;
+typedef WS2812Format<WS2812Core::RGB,  offsetof(WS2812Core::RGB, blue), offsetof(WS2812Core::RGB, red), offsetof(WS2812Core::RGB, green)> WS2812FormatBRG;
+typedef WS2812Format<WS2812Core::RGBW, offsetof(WS2812Core::RGBW, green), offsetof(WS2812Core::RGBW, red), offsetof(WS2812Core::RGBW, blue), offsetof(WS2812Core::RGBW, white)> WS2812FormatGRBW;
+typedef WS2812Format<WS2812Core::RGBW, offsetof(WS2812Core::RGBW, red), offsetof(WS2812Core::RGBW, green), offsetof(WS2812Core::RGBW, blue), offsetof(WS2812Core::RGBW, white)> WS2812FormatRGBW;
+typedef WS2812Format16<WS2812Core::GRB16,  offsetof(WS2812Core::GRB16, green), offsetof(WS2812Core::GRB16, red), offsetof(WS2812Core::GRB16, blue)> WS2812FormatGRB16;
+typedef WS2812Format16<WS2812Core::RGBW16, offsetof(WS2812Core::RGBW16, green), offsetof(WS2812Core::RGBW16, red), offsetof(WS2812Core::RGBW16, blue), offsetof(WS2812Core::RGBW16, white)> WS2812FormatGRBW16;
+
+/* The encoder of WS2812T, for any WS2812Core begun with its timings and
+ * pixel format; WS2812 uses it for the default timings. */
+template<
+    uint16_t cBitWidth = WS2812_DEFAULT_BIT_WIDTH_CLKS,
+    uint16_t cBit1High = WS2812_DEFAULT_BIT_1_HIGH_CLKS,
+    uint16_t cBit0High = WS2812_DEFAULT_BIT_0_HIGH_CLKS,
+    class TFormat = WS2812FormatGRB>
+class WS2812Encoder {
+
+    typedef typename TFormat::PIXEL PIXEL;
+    typedef typename TFormat::CHANNEL CHANNEL;
+    typedef WS2812SymbolTable<cBitWidth, cBit1High, cBit0High, typename WS2812MakeIndices<256>::type> SYMBOLS;
+
+public:
+
+    /***    void encode(WS2812Core * pThis, uint8_t * pDst, const void * pPixels, uint32_t iDevice, uint32_t cDevices)
+     *
+     *      Converts cDevices devices, starting with device iDevice of the chain, 
+     *      into the pattern buffer at pDst, taking the colors out of each pixel 
+     *      in the order TFormat sends them.
+     */
+    static void encode(WS2812Core * pThis, uint8_t * pDst, const void * pPixels, uint32_t iDevice, uint32_t cDevices)
+    {
+        // the color tables and the dither state only pick the loop once per run;
+        // 16 bit colors are past the 256 entry tables, so only dither
+        if(sizeof(CHANNEL) > 1 && pThis->_pDither != NULL)
+        {
+            encodeDevices<false, true>(pThis, pDst, (const uint8_t *) pPixels, &pThis->_pDither[iDevice * TFormat::cColors], cDevices);
+        }
+        else if(sizeof(CHANNEL) == 1 && pThis->_pColorLUT != NULL)
+        {
+            encodeDevices<true, false>(pThis, pDst, (const uint8_t *) pPixels, NULL, cDevices);
+        }
+        else
+        {
+            encodeDevices<false, false>(pThis, pDst, (const uint8_t *) pPixels, NULL, cDevices);
+        }
+    }
+
+private:
+
+    /* Which color of the device encodeColors() is on, so the colors are 
+     * unrolled at compile time whatever the format */
+    template<uint32_t i> struct COLOR {};
+
+    template<bool fLUT, bool fDither, class TOut>
+    static inline void __attribute__((always_inline)) encodeColors(TOut&, const uint8_t *, uint8_t *, const uint32_t *, const uint8_t *, uint32_t, COLOR<TFormat::cColors>)
+    {
+    }
+
+    template<bool fLUT, bool fDither, class TOut, uint32_t i>
+    static inline void __attribute__((always_inline)) encodeColors(TOut& out, const uint8_t * pPixel, uint8_t * pError, const uint32_t * rgSymbols, const uint8_t * pLUT, uint32_t invert, COLOR<i>)
+    {
+        uint32_t color = *(const CHANNEL *) (pPixel + TFormat::rgiColors[i]);
+
+        if(fDither)
+        {
+            // send the high byte of the color plus what the last refresh 
+            // left over, 255 if that carries out of 16 bits, and keep the rest
+            color       += pError[i];
+            pError[i]    = (uint8_t) color;
+            color        = (color >> 8) - (color >> 16);
+        }
+        else if(sizeof(CHANNEL) > 1)
+        {
+            color >>= 8;
+        }
+        else if(fLUT)
+        {
+            color = pLUT[(TFormat::rgiColors[i] << 8) + color];
+        }
+
+        out.put(rgSymbols[color] ^ invert, cBitWidth);
+        encodeColors<fLUT, fDither>(out, pPixel, pError, rgSymbols, pLUT, invert, COLOR<i + 1>());
+    }
+
+    template<bool fLUT, bool fDither, class TOut>
+    static inline void __attribute__((always_inline)) encodeRun(TOut& out, WS2812Core * pThis, const uint8_t * pPixel, uint8_t * pError, uint32_t cDevices)
+    {
+        const uint32_t * rgSymbols = SYMBOLS::rgSymbols;
+        const uint8_t * pLUT = pThis->_pColorLUT;
+        uint32_t invert = pThis->_fInvert ? 0xFFFFFFFF : 0;
+
+        for(; cDevices > 0; cDevices--, pPixel += sizeof(PIXEL))
+        {
+            encodeColors<fLUT, fDither>(out, pPixel, pError, rgSymbols, pLUT, invert, COLOR<0>());
+
+            if(fDither)
+            {
+                pError += TFormat::cColors;
+            }
+        }
+        out.flush();
+    }
+
+    template<bool fLUT, bool fDither>
+    static void encodeDevices(WS2812Core * pThis, uint8_t * pDst, const uint8_t * pPixel, uint8_t * pError, uint32_t cDevices)
+    {
+        // a 4 clock symbol is a word, one store if the run is on a word boundary
+        if(cBitWidth == 4 && ((uintptr_t) pDst & 3) == 0)
+        {
+            WS2812Core::Words words(pDst, pThis->_fMode32);
+            encodeRun<fLUT, fDither>(words, pThis, pPixel, pError, cDevices);
+        }
+        else
+        {
+            WS2812Core::Packer packer(pDst, pThis->_fMode32);
+            encodeRun<fLUT, fDither>(packer, pThis, pPixel, pError, cDevices);
+        }
+    }
+};
+
+/* WS2812 with the bit timings fixed at compile time. The symbol table is
+ * a constant, so it costs no RAM, and the encode loop has no run time 
+ * branches on the bit timing; an inverted signal is one XOR per color.
+ * Use this unless the timing is only known at run time. */
+template<
+    uint16_t cBitWidth = WS2812_DEFAULT_BIT_WIDTH_CLKS,
+    uint16_t cBit1High = WS2812_DEFAULT_BIT_1_HIGH_CLKS,
+    uint16_t cBit0High = WS2812_DEFAULT_BIT_0_HIGH_CLKS,
+    class TFormat = WS2812FormatGRB>
+class WS2812T : public WS2812Core {
+
+    static_assert(cBitWidth >= 3 && cBitWidth <= 4 && cBitWidth <= WS2812_MAX_SPI_CLOCKS_PER_LED_BIT,
+        "WS2812T bit width must be 3 or 4 SPI clocks and fit in WS2812_MAX_SPI_CLOCKS_PER_LED_BIT");
+    static_assert(cBit1High < cBitWidth && cBit0High < cBitWidth,
+        "WS2812T high times must be shorter than the bit width");
+    static_assert(cBit0High > 0 && cBit1High > cBit0High,
+        "WS2812T 0 bit must have a high time and the 1 bit a longer one");
+
+    static_assert(TFormat::cColors > 0 && TFormat::cColors <= 4 && TFormat::cColors * sizeof(typename TFormat::CHANNEL) <= sizeof(typename TFormat::PIXEL),
+        "WS2812T pixel format must send 1 to 4 of the pixel's colors");
+
+    typedef WS2812Encoder<cBitWidth, cBit1High, cBit0High, TFormat> ENCODER;
+
+public:
+
+    typedef typename TFormat::PIXEL PIXEL;
+    typedef typename TFormat::CHANNEL CHANNEL;
+
+    bool updateLEDs(PIXEL rgPixels[], uint32_t cPass = 5)           { return(updatePixels(rgPixels, cPass)); }
+    bool updateDirtyLEDs(PIXEL rgPixels[], uint32_t cPass = 5)      { return(updateDirtyPixels(rgPixels, cPass)); }
+    bool updateLEDsFor(PIXEL rgPixels[], uint32_t usBudget)         { return(updatePixelsFor(rgPixels, usBudget)); }
+    bool updateDirtyLEDsFor(PIXEL rgPixels[], uint32_t usBudget)    { return(updateDirtyPixelsFor(rgPixels, usBudget)); }
+    bool setPalette(const PIXEL rgPalette[], uint32_t cPalette, uint8_t * pSymbols, uint32_t cbSymbols) { return(setPalettePixels(rgPalette, cPalette, pSymbols, cbSymbols)); }
+    bool fillLEDs(const PIXEL& pixel, uint32_t iDevice = 0, uint32_t cDevices = 0xFFFFFFFF)                             { return(fillPixels(&pixel, 1, iDevice, cDevices)); }
+    bool repeatLEDs(const PIXEL rgPattern[], uint32_t cPattern, uint32_t iDevice = 0, uint32_t cDevices = 0xFFFFFFFF)   { return(fillPixels(rgPattern, cPattern, iDevice, cDevices)); }
+    bool scrollLEDs(int32_t cShift)                                                                                     { return(scrollPixels(cShift, NULL)); }
+    bool scrollLEDs(int32_t cShift, const PIXEL rgPixels[])                                                             { return(scrollPixels(cShift, rgPixels)); }
+
+    bool begin(
+        uint32_t cDevices, 
+        uint8_t * pPatternBuffer, 
+        uint32_t cbPatternBuffer, 
+        bool fInvert = false,
+        uint8_t iSPI = WS2812_DEFAULT_SPI,
+        uint8_t iDMA = WS2812_DEFAULT_DMA)
+    {
+        return(WS2812Core::begin(cDevices, pPatternBuffer, NULL, cbPatternBuffer, fInvert, cBitWidth, cBit1High, cBit0High, iSPI, iDMA, ENCODER::encode, false, TFormat::cColors, sizeof(PIXEL)));
+    }
+
+    bool begin(
+        uint32_t cDevices, 
+        uint8_t * pPatternBuffer, 
+        uint8_t * pPatternBuffer2, 
+        uint32_t cbPatternBuffer, 
+        bool fInvert = false,
+        uint8_t iSPI = WS2812_DEFAULT_SPI,
+        uint8_t iDMA = WS2812_DEFAULT_DMA)
+    {
+        return(WS2812Core::begin(cDevices, pPatternBuffer, pPatternBuffer2, cbPatternBuffer, fInvert, cBitWidth, cBit1High, cBit0High, iSPI, iDMA, ENCODER::encode, false, TFormat::cColors, sizeof(PIXEL)));
+    }
+
+    bool beginStream(
+        uint32_t cDevices, 
+        uint8_t * pRing, 
+        uint32_t cbRing, 
+        bool fInvert = false,
+        uint8_t iSPI = WS2812_DEFAULT_SPI,
+        uint8_t iDMA = WS2812_DEFAULT_DMA)
+    {
+        return(WS2812Core::begin(cDevices, pRing, NULL, cbRing, fInvert, cBitWidth, cBit1High, cBit0High, iSPI, iDMA, ENCODER::encode, true, TFormat::cColors, sizeof(PIXEL)));
+    }
+};
+
+/* WS2812 with the bit timings given to begin() at run time. The symbol
+ * table is built in RAM by begin(); with the default timings begin() 
+ * uses WS2812Encoder<>, the WS2812T encoder, and the table is not needed. */
+class WS2812 : public WS2812Core {
+   
+public:
+
+    bool begin(
+        uint32_t cDevices, 
+        uint8_t * pPatternBuffer, 
+        uint32_t cbPatternBuffer, 
+        bool fInvert = false,
+        uint16_t cBitWidth = WS2812_DEFAULT_BIT_WIDTH_CLKS, 
+        uint16_t cBit1High = WS2812_DEFAULT_BIT_1_HIGH_CLKS, 
+        uint16_t cBit0High = WS2812_DEFAULT_BIT_0_HIGH_CLKS,
+        uint8_t iSPI = WS2812_DEFAULT_SPI,
+        uint8_t iDMA = WS2812_DEFAULT_DMA)
+    {
+        return(begin(cDevices, pPatternBuffer, NULL, cbPatternBuffer, fInvert, cBitWidth, cBit1High, cBit0High, iSPI, iDMA));
+    }
+
+    bool begin(
+        uint32_t cDevices, 
+        uint8_t * pPatternBuffer, 
+        uint8_t * pPatternBuffer2, 
+        uint32_t cbPatternBuffer, 
+        bool fInvert = false,
+        uint16_t cBitWidth = WS2812_DEFAULT_BIT_WIDTH_CLKS, 
+        uint16_t cBit1High = WS2812_DEFAULT_BIT_1_HIGH_CLKS, 
+        uint16_t cBit0High = WS2812_DEFAULT_BIT_0_HIGH_CLKS,
+        uint8_t iSPI = WS2812_DEFAULT_SPI,
+        uint8_t iDMA = WS2812_DEFAULT_DMA);
+
+    bool beginStream(
+        uint32_t cDevices, 
+        uint8_t * pRing, 
+        uint32_t cbRing, 
+        bool fInvert = false,
+        uint16_t cBitWidth = WS2812_DEFAULT_BIT_WIDTH_CLKS, 
+        uint16_t cBit1High = WS2812_DEFAULT_BIT_1_HIGH_CLKS, 
+        uint16_t cBit0High = WS2812_DEFAULT_BIT_0_HIGH_CLKS,
+        uint8_t iSPI = WS2812_DEFAULT_SPI,
+        uint8_t iDMA = WS2812_DEFAULT_DMA);
+
+    /* The same with the LED timings in nS, the SPI clock and symbols are picked to meet them */
+    bool begin(
+        uint32_t cDevices, 
+        uint8_t * pPatternBuffer, 
+        uint32_t cbPatternBuffer, 
+        const TIMING& timing,
+        bool fInvert = false,
+        uint8_t iSPI = WS2812_DEFAULT_SPI,
+        uint8_t iDMA = WS2812_DEFAULT_DMA)
+    {
+        return(begin(cDevices, pPatternBuffer, NULL, cbPatternBuffer, timing, fInvert, iSPI, iDMA));
+    }
+
+    bool begin(
+        uint32_t cDevices, 
+        uint8_t * pPatternBuffer, 
+        uint8_t * pPatternBuffer2, 
+        uint32_t cbPatternBuffer, 
+        const TIMING& timing,
+        bool fInvert = false,
+        uint8_t iSPI = WS2812_DEFAULT_SPI,
+        uint8_t iDMA = WS2812_DEFAULT_DMA);
+
+    bool beginStream(
+        uint32_t cDevices, 
+        uint8_t * pRing, 
+        uint32_t cbRing, 
+        const TIMING& timing,
+        bool fInvert = false,
+        uint8_t iSPI = WS2812_DEFAULT_SPI,
+        uint8_t iDMA = WS2812_DEFAULT_DMA);
+
+private:
+
+    bool start(
+        uint32_t cDevices, 
+        uint8_t * pPatternBuffer, 
+        uint8_t * pPatternBuffer2, 
+        uint32_t cbPatternBuffer, 
+        bool fInvert,
+        uint16_t cBitWidth, 
+        uint16_t cBit1High, 
+        uint16_t cBit0High,
+        uint8_t iSPI,
+        uint8_t iDMA,
+        bool fStream,
+        uint32_t spiClockRate = WS2812_SPI_CLOCK_RATE);
+
+#if (WS2812_ENCODE_TABLE == WS2812_ENCODE_TABLE_FULL)
+    uint32_t        _rgSymbols[256];        // SPI pattern of every color byte, in pattern buffer byte order
+#else
+    uint16_t        _rgSymbols[16];         // SPI pattern of every nibble, first SPI clock in the MSb
+#endif
+
+    void buildSymbols(void);
+    static void encodeSymbols(WS2812Core * pWS2812, uint8_t * pDst, const void * pPixels, uint32_t iDevice, uint32_t cDevices);
+    template<uint32_t cbColor, bool fLUT> void encodeTable(uint8_t * pDst, const GRB * pGRB, uint32_t cDevices);
+    template<uint32_t cbColor, bool fLUT, class TOut> void encodeRun(TOut& out, const GRB * pGRB, uint32_t cDevices);
+#if (WS2812_MAX_SPI_CLOCKS_PER_LED_BIT > 4)
+    void encodeBits(uint8_t * pDst, const GRB * pGRB, uint32_t cDevices);
+#endif
 };
 
+#endif // _WS2812_H
@@ -0,0 +1,416 @@
+/************************************************************************/
+/*                                                                      */
+/*    WS2812Decode.cpp                                                  */
+/*                                                                      */
+/*    Decodes a pattern buffer back into devices the way a WS2812       */
+/*    would, and checks the high and low times of every bit             */
+/*                                                                      */
+/************************************************************************/
+/*
+*
+* Copyright (c) 2014, Digilent <www.digilentinc.com>
+* Contact Digilent for the latest version.
+*
+* This program is free software; distributed under the terms of
+* BSD 3-clause license ("Revised BSD License", "New BSD License", or "Modified BSD License")
+*
+* Redistribution and use in source and binary forms, with or without modification,
+* are permitted provided that the following conditions are met:
+*
+* 1.    Redistributions of source code must retain the above copyright notice, this
+*        list of conditions and the following disclaimer.
+* 2.    Redistributions in binary form must reproduce the above copyright notice,
+*        this list of conditions and the following disclaimer in the documentation
+*        and/or other materials provided with the distribution.
+* 3.    Neither the name(s) of the above-listed copyright holder(s) nor the names
+*        of its contributors may be used to endorse or promote products derived
+*        from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+* IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+* BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+* LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#if defined(WS2812_HOST)
+
+#include <WS2812Decode.h>
+
+const WS2812Decoder::TIMING& WS2812Decoder::timingMeasured    = WS2812Core::timingMeasured;
+const WS2812Decoder::TIMING& WS2812Decoder::timingWS2812      = WS2812Core::timingWS2812;
+const WS2812Decoder::TIMING& WS2812Decoder::timingWS2812B     = WS2812Core::timingWS2812B;
+
+/***    WS2812Decoder::WS2812Decoder(const TIMING& timing, uint32_t spiClockRate)
+ *
+ *    Parameters:
+ *          timing:         The limits to check every bit against
+ *
+ *          spiClockRate:   The SPI clock rate the pattern buffer is shifted out at
+ *
+ *    Description:
+ *
+ *      A bit is read as a 1 if it is still high half way between the
+ *      longest 0 high time and the shortest 1 high time.
+ *
+ * ------------------------------------------------------------ */
+WS2812Decoder::WS2812Decoder(const TIMING& timing, uint32_t spiClockRate) :
+    _timing(timing)
+{
+    _spiClockRate   = spiClockRate;
+    _nsSample       = (timing.t0High.nsMax + timing.t1High.nsMin) / 2;
+    _cBits          = 0;
+    _cFaults        = 0;
+    _iFirstFault    = 0;
+    _fLatched       = false;
+    _random         = 1;
+    memset(&_measured, 0, sizeof(_measured));
+}
+
+/***    uint32_t WS2812Decoder::decode(const uint8_t * pPatternBuffer, uint32_t cbPatternBuffer, bool fInvert, 
+ *                                     WS2812Core::GRB rgGRB[], uint32_t cDevices, BIT rgBit[], uint32_t cBitMax,
+ *                                     bool fMode32)
+ *
+ *    Parameters:
+ *          pPatternBuffer:     The pattern buffer to decode
+ *
+ *          cbPatternBuffer:    The number of bytes in pPatternBuffer
+ *
+ *          fInvert:            True if the pattern buffer holds the inverted signal
+ *
+ *          rgGRB:              Where to put the decoded devices, or NULL
+ *
+ *          cDevices:           How many devices rgGRB has room for
+ *
+ *          rgBit:              Where to put the times of every bit, or NULL
+ *
+ *          cBitMax:            How many bits rgBit has room for
+ *
+ *          fMode32:            True if the pattern buffer is in word order, see
+ *                              WS2812Core::setMode32(); a part word at the end is ignored
+ *
+ *    Return Values:
+ *          The number of whole devices decoded
+ *
+ *    Description:
+ *
+ *      Each bit starts with a rising edge, its high time runs to the 
+ *      falling edge and its low time runs to the next rising edge. The
+ *      times are checked against the limits given to the constructor;
+ *      cFaults(), iFirstFault() and measured() report what was found.
+ *      The low time of the last bit runs into the reset period, so only
+ *      its high time is checked.
+ *
+ *      Decoding stops at a low as long as the reset time, as that is
+ *      where the chain would latch; fLatched() is true if there was
+ *      anything but a low after it.
+ *
+ * ------------------------------------------------------------ */
+uint32_t WS2812Decoder::decode(
+    const uint8_t * pPatternBuffer, 
+    uint32_t cbPatternBuffer, 
+    bool fInvert, 
+    WS2812Core::GRB rgGRB[], 
+    uint32_t cDevices, 
+    BIT rgBit[], 
+    uint32_t cBitMax,
+    bool fMode32)
+{
+    uint32_t    cClocks     = 8 * (fMode32 ? (cbPatternBuffer & ~3) : cbPatternBuffer);
+    uint32_t    ibSwap      = fMode32 ? 3 : 0;
+    uint32_t    iClock      = 0;
+    uint32_t    color       = 0;
+    uint32_t    iDevice     = 0;
+    uint8_t     idle        = fInvert ? 0xFF : 0;
+
+    _cBits          = 0;
+    _cFaults        = 0;
+    _iFirstFault    = 0;
+    _fLatched       = false;
+    _measured.t0High.nsMin = _measured.t0Low.nsMin = _measured.t1High.nsMin = _measured.t1Low.nsMin = _measured.period.nsMin = 0xFFFFFFFF;
+    _measured.t0High.nsMax = _measured.t0Low.nsMax = _measured.t1High.nsMax = _measured.t1Low.nsMax = _measured.period.nsMax = 0;
+    _measured.nsReset = 0;
+
+    // in word order each word goes out MSb first, its last byte first
+    #define LEVEL(__i) ((((pPatternBuffer[((__i) >> 3) ^ ibSwap] ^ idle) << ((__i) & 7)) & 0x80) != 0)
+
+    // the signal is low up to the first bit
+    while(iClock < cClocks && !LEVEL(iClock))
+    {
+        iClock++;
+    }
+
+    while(iClock < cClocks)
+    {
+        uint32_t    cHigh   = 0;
+        uint32_t    cLow    = 0;
+        BIT         bit;
+
+        for(; iClock < cClocks && LEVEL(iClock); iClock++)
+        {
+            cHigh++;
+        }
+        for(; iClock < cClocks && !LEVEL(iClock); iClock++)
+        {
+            cLow++;
+        }
+
+        bit.nsHigh  = nsOfClocks(cHigh);
+        bit.nsLow   = nsOfClocks(cLow);
+        bit.fOne    = (bit.nsHigh >= _nsSample);
+        bit.fault   = 0;
+
+        if(!inRange(bit.fOne ? _timing.t1High : _timing.t0High, bit.nsHigh))
+        {
+            bit.fault |= FAULTHIGH;
+        }
+        widen(bit.fOne ? _measured.t1High : _measured.t0High, bit.nsHigh);
+
+        // the last bit's low time is the reset
+        if(iClock < cClocks && bit.nsLow < _timing.nsReset)
+        {
+            if(!inRange(bit.fOne ? _timing.t1Low : _timing.t0Low, bit.nsLow))
+            {
+                bit.fault |= FAULTLOW;
+            }
+            if(!inRange(_timing.period, bit.nsHigh + bit.nsLow))
+            {
+                bit.fault |= FAULTPERIOD;
+            }
+            widen(bit.fOne ? _measured.t1Low : _measured.t0Low, bit.nsLow);
+            widen(_measured.period, bit.nsHigh + bit.nsLow);
+        }
+
+        if(bit.fault != 0)
+        {
+            if(_cFaults == 0)
+            {
+                _iFirstFault = _cBits;
+            }
+            _cFaults++;
+        }
+
+        if(rgBit != NULL && _cBits < cBitMax)
+        {
+            rgBit[_cBits] = bit;
+        }
+        _cBits++;
+
+        // every 24 bits is a device, green first and MSb first
+        color = (color << 1) | bit.fOne;
+        if((_cBits % 24) == 0)
+        {
+            if(rgGRB != NULL && iDevice < cDevices)
+            {
+                rgGRB[iDevice].green    = (uint8_t) (color >> 16);
+                rgGRB[iDevice].red      = (uint8_t) (color >> 8);
+                rgGRB[iDevice].blue     = (uint8_t) color;
+            }
+            iDevice++;
+            color = 0;
+        }
+
+        // the chain latches here, anything after is the next frame
+        if(bit.nsLow >= _timing.nsReset)
+        {
+            _fLatched = (iClock < cClocks);
+            _measured.nsReset = bit.nsLow;
+            break;
+        }
+    }
+
+    #undef LEVEL
+
+    if(_cFaults == 0)
+    {
+        _iFirstFault = _cBits;
+    }
+
+    return(iDevice);
+}
+
+/***    uint32_t WS2812Decoder::compare(WS2812Core& ws2812A, const uint8_t * pPatternBufferA, 
+ *                                      WS2812Core * pWS2812B, const uint8_t * pPatternBufferB, uint32_t cbPatternBuffer, 
+ *                                      bool fInvert, WS2812Core::GRB rgGRB[], WS2812Core::GRB rgDecoded[], 
+ *                                      uint32_t cDevices, uint32_t cFrames, uint32_t seed)
+ *
+ *    Parameters:
+ *          ws2812A:            A WS2812 or WS2812T that begin() has been called on
+ *                              with a single pattern buffer
+ *
+ *          pPatternBufferA:    The pattern buffer given to ws2812A.begin()
+ *
+ *          pWS2812B:           A second WS2812 or WS2812T to check ws2812A against, or NULL
+ *
+ *          pPatternBufferB:    The pattern buffer given to pWS2812B->begin()
+ *
+ *          cbPatternBuffer:    The size of the pattern buffers
+ *
+ *          fInvert:            What fInvert was given to begin()
+ *
+ *          rgGRB:              cDevices devices to fill with random frames
+ *
+ *          rgDecoded:          cDevices devices to decode the pattern buffers into
+ *
+ *          cDevices:           The number of devices given to begin()
+ *
+ *          cFrames:            How many frames to try
+ *
+ *          seed:               Picks the frames, the same seed tries the same frames
+ *
+ *    Return Values:
+ *          The number of frames that did not decode back to what was sent
+ *
+ *    Description:
+ *
+ *      A randomized differential test of the encoders. Each frame sets
+ *      random devices to random colors, updates them with a random cPass,
+ *      either all with updateLEDs() or some with updateDirtyLEDs(), and
+ *      checks that each pattern buffer decodes back to rgGRB. The two 
+ *      objects may have different bit timings, or be in MODE32, as the
+ *      decoded devices are compared, not the pattern bytes. Time is not
+ *      checked here, call decode() for the timing of the last frame.
+ *
+ *      Each update is run until it is done, so with the board's own
+ *      driver this waits on the refresh cycle; a WS2812HostDriver that
+ *      is not advanced never holds up an update.
+ *
+ * ------------------------------------------------------------ */
+uint32_t WS2812Decoder::compare(
+    WS2812Core& ws2812A, 
+    const uint8_t * pPatternBufferA, 
+    WS2812Core * pWS2812B, 
+    const uint8_t * pPatternBufferB, 
+    uint32_t cbPatternBuffer, 
+    bool fInvert, 
+    WS2812Core::GRB rgGRB[], 
+    WS2812Core::GRB rgDecoded[], 
+    uint32_t cDevices, 
+    uint32_t cFrames, 
+    uint32_t seed)
+{
+    uint32_t        cFail   = 0;
+    uint32_t        iFrame  = 0;
+
+    _random = (seed != 0) ? seed : 1;
+
+    for(iFrame = 0; iFrame < cFrames; iFrame++)
+    {
+        uint32_t    iFirst  = 0;
+        uint32_t    cDirty  = cDevices;
+        uint32_t    cPass   = 1 + (random() % cDevices);
+        bool        fDirty  = (iFrame > 0) && ((random() & 1) != 0);
+        bool        fPass   = true;
+        uint32_t    i       = 0;
+
+        // some frames only change a few devices
+        if(fDirty)
+        {
+            iFirst  = random() % cDevices;
+            cDirty  = 1 + (random() % (cDevices - iFirst));
+        }
+
+        for(i = iFirst; i < iFirst + cDirty; i++)
+        {
+            uint32_t rgb = random();
+
+            rgGRB[i].green  = (uint8_t) rgb;
+            rgGRB[i].red    = (uint8_t) (rgb >> 8);
+            rgGRB[i].blue   = (uint8_t) (rgb >> 16);
+        }
+
+        if(fDirty)
+        {
+            ws2812A.markDirty(iFirst, cDirty);
+            while(!ws2812A.updateDirtyLEDs(rgGRB, cPass));
+            if(pWS2812B != NULL)
+            {
+                pWS2812B->markDirty(iFirst, cDirty);
+                while(!pWS2812B->updateDirtyLEDs(rgGRB, cPass));
+            }
+        }
+        else
+        {
+            while(!ws2812A.updateLEDs(rgGRB, cPass));
+            if(pWS2812B != NULL)
+            {
+                while(!pWS2812B->updateLEDs(rgGRB, cPass));
+            }
+        }
+
+        for(i = 0; i < 2 && fPass; i++)
+        {
+            const uint8_t * pPatternBuffer = (i == 0) ? pPatternBufferA : pPatternBufferB;
+            WS2812Core *    pWS2812        = (i == 0) ? &ws2812A : pWS2812B;
+
+            if(i == 1 && pWS2812B == NULL)
+            {
+                break;
+            }
+
+            if(decode(pPatternBuffer, cbPatternBuffer, fInvert, rgDecoded, cDevices, NULL, 0, pWS2812->mode32()) != cDevices ||
+                memcmp(rgDecoded, rgGRB, cDevices * sizeof(WS2812Core::GRB)) != 0)
+            {
+                fPass = false;
+            }
+        }
+
+        if(!fPass)
+        {
+            cFail++;
+        }
+    }
+
+    return(cFail);
+}
+
+/***    uint32_t WS2812Decoder::nsOfClocks(uint32_t cClocks)
+ *
+ *    Parameters:
+ *          cClocks:    A number of SPI clocks
+ *
+ *    Return Values:
+ *          How long cClocks SPI clocks are, in nS, rounded
+ *
+ * ------------------------------------------------------------ */
+uint32_t WS2812Decoder::nsOfClocks(uint32_t cClocks)
+{
+    return((uint32_t) (((uint64_t) cClocks * 1000000000ull + (_spiClockRate / 2)) / _spiClockRate));
+}
+
+/***    uint32_t WS2812Decoder::random(void)
+ *
+ *    Return Values:
+ *          The next number from a 32 bit xorshift generator
+ *
+ * ------------------------------------------------------------ */
+uint32_t WS2812Decoder::random(void)
+{
+    _random ^= _random << 13;
+    _random ^= _random >> 17;
+    _random ^= _random << 5;
+    return(_random);
+}
+
+void WS2812Decoder::widen(RANGE& range, uint32_t ns)
+{
+    if(ns < range.nsMin)
+    {
+        range.nsMin = ns;
+    }
+    if(ns > range.nsMax)
+    {
+        range.nsMax = ns;
+    }
+}
+
+bool WS2812Decoder::inRange(const RANGE& range, uint32_t ns)
+{
+    return(ns >= range.nsMin && ns <= range.nsMax);
+}
+
+#endif // WS2812_HOST
@@ -0,0 +1,134 @@
+/************************************************************************/
+/*                                                                      */
+/*    WS2812Decode.h                                                    */
+/*                                                                      */
+/*    Decodes a pattern buffer back into devices the way a WS2812       */
+/*    would, and checks the high and low times of every bit             */
+/*                                                                      */
+/************************************************************************/
+/*
+*
+* Copyright (c) 2014, Digilent <www.digilentinc.com>
+* Contact Digilent for the latest version.
+*
+* This program is free software; distributed under the terms of
+* BSD 3-clause license ("Revised BSD License", "New BSD License", or "Modified BSD License")
+*
+* Redistribution and use in source and binary forms, with or without modification,
+* are permitted provided that the following conditions are met:
+*
+* 1.    Redistributions of source code must retain the above copyright notice, this
+*        list of conditions and the following disclaimer.
+* 2.    Redistributions in binary form must reproduce the above copyright notice,
+*        this list of conditions and the following disclaimer in the documentation
+*        and/or other materials provided with the distribution.
+* 3.    Neither the name(s) of the above-listed copyright holder(s) nor the names
+*        of its contributors may be used to endorse or promote products derived
+*        from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+* IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+* BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+* LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/************************************************************************/
+/*                                                                      */
+/*  WS2812Decoder does not know how the pattern buffer was encoded.     */
+/*  It walks the SPI bit stream, times every high and low run at the    */
+/*  SPI clock rate, and samples each bit part way into its high time    */
+/*  the same as the WS2812 does. It is meant to be the reference that   */
+/*  the encoders are checked against on the host, so like the host     */
+/*  driver it is only built with WS2812_HOST defined.                   */
+/*                                                                      */
+/************************************************************************/
+#ifndef _WS2812DECODE_H
+#define _WS2812DECODE_H
+
+#include <WS2812.h>
+
+#if defined(WS2812_HOST)
+class WS2812Decoder {
+
+public:
+
+    /* The same limits WS2812::begin() picks the SPI clock for */
+    typedef WS2812Core::RANGE RANGE;
+    typedef WS2812Core::TIMING TIMING;
+
+    /* What was wrong with a bit */
+    typedef enum
+    {
+        FAULTHIGH   = 0x01,     // the high time is out of range
+        FAULTLOW    = 0x02,     // the low time is out of range
+        FAULTPERIOD = 0x04      // the high + low time is out of range
+    } FAULT;
+
+    typedef struct _BIT
+    {
+        uint32_t    nsHigh;
+        uint32_t    nsLow;      // for the last bit, only up to the end of the pattern buffer
+        uint8_t     fOne;
+        uint8_t     fault;      // FAULT flags, 0 if in spec
+    } BIT;
+
+    static const TIMING& timingMeasured;    // what WS2812s have been measured to accept
+    static const TIMING& timingWS2812;      // the WS2812 / WS2812S data sheet
+    static const TIMING& timingWS2812B;     // the WS2812B data sheet
+
+    WS2812Decoder(const TIMING& timing = timingMeasured, uint32_t spiClockRate = WS2812_SPI_CLOCK_RATE);
+
+    uint32_t decode(
+        const uint8_t * pPatternBuffer, 
+        uint32_t cbPatternBuffer, 
+        bool fInvert, 
+        WS2812Core::GRB rgGRB[], 
+        uint32_t cDevices, 
+        BIT rgBit[] = NULL, 
+        uint32_t cBitMax = 0,
+        bool fMode32 = false);
+
+    uint32_t compare(
+        WS2812Core& ws2812A, 
+        const uint8_t * pPatternBufferA, 
+        WS2812Core * pWS2812B, 
+        const uint8_t * pPatternBufferB, 
+        uint32_t cbPatternBuffer, 
+        bool fInvert, 
+        WS2812Core::GRB rgGRB[], 
+        WS2812Core::GRB rgDecoded[], 
+        uint32_t cDevices, 
+        uint32_t cFrames, 
+        uint32_t seed = 1);
+
+    uint32_t        cBits(void)         { return(_cBits); }
+    uint32_t        cFaults(void)       { return(_cFaults); }
+    uint32_t        iFirstFault(void)   { return(_iFirstFault); }
+    bool            fLatched(void)      { return(_fLatched); }
+    const TIMING&   measured(void)      { return(_measured); }
+
+private:
+
+    TIMING          _timing;
+    uint32_t        _spiClockRate;
+    uint32_t        _nsSample;          // a bit high this long or longer is a 1
+    uint32_t        _cBits;             // bits decoded by the last decode()
+    uint32_t        _cFaults;           // bits that were out of spec
+    uint32_t        _iFirstFault;       // the first of them, or _cBits
+    bool            _fLatched;          // a reset length low came before the end of the pattern buffer
+    TIMING          _measured;          // the shortest and longest times seen
+    uint32_t        _random;
+
+    uint32_t        nsOfClocks(uint32_t cClocks);
+    uint32_t        random(void);
+    static void     widen(RANGE& range, uint32_t ns);
+    static bool     inRange(const RANGE& range, uint32_t ns);
+};
+#endif // WS2812_HOST
+
+#endif // _WS2812DECODE_H
@@ -0,0 +1,470 @@
+/************************************************************************/
+/*                                                                      */
+/*    WS2812Driver.h                                                    */
+/*                                                                      */
+/*    The interface between the WS2812 update state machine and the     */
+/*    hardware that streams the pattern buffer out to the chain         */
+/*                                                                      */
+/************************************************************************/
+/*
+*
+* Copyright (c) 2014, Digilent <www.digilentinc.com>
+* Contact Digilent for the latest version.
+*
+* This program is free software; distributed under the terms of
+* BSD 3-clause license ("Revised BSD License", "New BSD License", or "Modified BSD License")
+*
+* Redistribution and use in source and binary forms, with or without modification,
+* are permitted provided that the following conditions are met:
+*
+* 1.    Redistributions of source code must retain the above copyright notice, this
+*        list of conditions and the following disclaimer.
+* 2.    Redistributions in binary form must reproduce the above copyright notice,
+*        this list of conditions and the following disclaimer in the documentation
+*        and/or other materials provided with the distribution.
+* 3.    Neither the name(s) of the above-listed copyright holder(s) nor the names
+*        of its contributors may be used to endorse or promote products derived
+*        from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+* IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+* BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+* LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/************************************************************************/
+/*                                                                      */
+/*  WS2812Pic32Driver is the SPIx / DMA channel pair implementation in  */
+/*  CoreTimer.c, and is what every WS2812 uses on a chipKIT board. Each */
+/*  object has its own SPI and DMA channels, picked on begin().         */
+/*                                                                      */
+/*  WS2812HostDriver does not touch any hardware. It runs the same      */
+/*  refresh logic from CoreTimer.c against a simulated SPI and DMA      */
+/*  channel pair, timed in core timer ticks, and captures the bytes     */
+/*  that would have been shifted out on SDO, so the encoder, update     */
+/*  state machine and refresh can be run and checked off target.        */
+/*  Build with WS2812_HOST defined to use the library on a PC, see      */
+/*  README.md.                                                          */
+/*                                                                      */
+/************************************************************************/
+#ifndef _WS2812DRIVER_H
+#define _WS2812DRIVER_H
+
+#if defined(WS2812_HOST)
+    #include <stdint.h>
+    #include <stddef.h>
+    #include <string.h>
+    /* The core timer runs at half of an 80MHz CPU clock, in ticks per ms */
+    #if !defined(CORE_TICK_RATE)
+        #define CORE_TICK_RATE  (40000)
+    #endif
+    /* The peripheral bus clock the SPI clock is divided down from, see pbClock() */
+    #if !defined(WS2812_HOST_PBCLK)
+        #define WS2812_HOST_PBCLK   (80000000)
+    #endif
+    /* A host driver is only run from one thread, there are no interrupts to hold off */
+    #define disableInterrupts()         (0)
+    #define restoreInterrupts(__st)     ((void) (__st))
+#else
+    #include <WProgram.h>
+    /* Reads the CP0 count register, the core timer, into dest */
+    #define read_count(dest) __asm__ __volatile__("mfc0 %0,$9" : "=r" (dest))
+#endif
+
+#define TICKSPERSHORTCHECK  (5 * CORE_TICK_RATE)        // 5ms
+#define TICKSPERREFRESH     (30 * CORE_TICK_RATE)       // 30ms, the default, see setRefreshPeriod()
+/* How long the chain is held at the reset level after a refresh before the
+ * next one may start. The WS2812 needs 50uS, newer WS2812Bs need 280uS. */
+#define WS2812_RESET_US     (300)
+/* This is the clock rate for the SPI port. This is the fundamental unit that
+ * the 1 and 0 high and low times are expressed in. This value of 3MHz was
+ * picked because it allows for a low error rate on the various chipKIT
+ * boards, and it still allows the timing requirements of the WS2812 LEDs to
+ * be met. WS2812::begin() given a TIMING picks its own rate instead. */
+#define WS2812_SPI_CLOCK_RATE   (3000000)
+/* The most the peripheral bus clock can be divided by for the SPI clock, 
+ * 2 * (SPIxBRG + 1) with the 9 bits of SPIxBRG every PIC32 has */
+#define WS2812_MAX_SPI_DIVIDER  (1024)
+/* The SPI enhanced buffer, still to shift out when the pattern DMA channel is done */
+#define CBSPIFIFO               (16)
+/* The SPI and first of the 2 DMA channels begin() uses unless told otherwise */
+#define WS2812_DEFAULT_SPI      (2)
+#define WS2812_DEFAULT_DMA      (0)
+
+/* Called when an update is on the chain */
+typedef void (* PFNWS2812FRAMEDONE)(void * pContext);
+
+/* Streaming: called to put bytes ib to ib + cb of a refresh into pb */
+typedef void (* PFNWS2812FILL)(void * pContext, uint8_t * pb, uint32_t ib, uint32_t cb);
+
+/* Streaming: the halves of the ring the pattern DMA channel has finished, see StreamWS2812() */
+#define WS2812_RING_HALF0   0x01
+#define WS2812_RING_HALF1   0x02
+
+/* Counters for a chain, see getStats(). Times are core timer ticks, 
+ * CORE_TICK_RATE to the mS; on a PIC32MX a tick is 2 CPU clocks. The 
+ * driver keeps the refresh and DMA counters, WS2812Core the rest. */
+typedef struct _WS2812STATS
+{
+    uint32_t    cRefreshes;     // refreshes started
+    uint32_t    cLate;          // refreshes not ready when due, caught up every TICKSPERSHORTCHECK
+    uint32_t    cSkipped;       // refresh periods that went by without a refresh
+    uint32_t    tMaxLate;       // the most a refresh started after it was due
+    uint64_t    tDMABusy;       // the pattern DMA channel streaming refreshes
+    uint32_t    cUnderruns;     // streamed refreshes stopped, the DMA interrupt was too late to refill the ring
+    uint32_t    cFrames;        // updates committed
+    uint32_t    cCaught;        // updates started early that the DMA caught up with, see setEarlyStart()
+    uint32_t    tEncodeLast;    // converting the last update committed, or the last streamed refresh
+    uint32_t    tEncodeMax;     // the longest an update took to convert
+    uint64_t    tEncode;        // converting all of them
+} WS2812STATS;
+
+/* One event of the trace ring, see WS2812Core::setTrace(). 8 bytes, and
+ * dumpTrace() writes them as they are in memory, little endian. */
+typedef struct _WS2812EVENT
+{
+    uint32_t    t;              // the core timer when it happened
+    uint8_t     event;          // WS2812_TRACE_*
+    uint8_t     arg8;
+    uint16_t    arg;
+} WS2812EVENT;
+
+/* dumpTrace() writes this, then the events oldest first */
+typedef struct _WS2812TRACEHDR
+{
+    uint8_t     rgMagic[4];     // "WST1"
+    uint32_t    cWritten;       // events written since setTrace(), more than cEvents once the oldest are written over
+    uint32_t    cEvents;        // events that follow
+    uint32_t    tickRate;       // CORE_TICK_RATE, core timer ticks per mS
+} WS2812TRACEHDR;
+
+/* What the events are, and what arg8 and arg say */
+#define WS2812_TRACE_STATE      1   // the update state machine moved to arg8 from the low byte of arg,
+                                    // INIT 0, WAITUPD 1, CONVGRB 2, ENDUPD 3; arg bit 8 is a fill, bit 9 a scroll
+#define WS2812_TRACE_REFUSED    2   // the first time an update found the pattern buffer busy, arg8 1 if double buffered
+#define WS2812_TRACE_ABORT      3   // abortUpdate(), arg is the devices it had left to convert
+#define WS2812_TRACE_COMMIT     4   // an update was handed to the driver, arg8 1 if swapped in, arg its devices converted
+#define WS2812_TRACE_DMAON      5   // a refresh started the pattern DMA channel, arg8 1 if it has a new update
+#define WS2812_TRACE_DMAOFF     6   // the pattern DMA channel is done, the reset channel has the chain
+#define WS2812_TRACE_LATE       7   // a refresh was due and could not go, arg8 is WS2812_LATE_* of why
+#define WS2812_TRACE_FRAMEDONE  8   // an update is on the chain
+#define WS2812_TRACE_EARLY      9   // the refresh let go on a partly converted update, arg devices converted
+#define WS2812_TRACE_UNDERRUN   10  // a streamed refresh was stopped, arg the ring halves it had sent
+
+#define WS2812_LATE_UPDATING    0x01    // the pattern buffer is being updated
+#define WS2812_LATE_NEWFRAME    0x02    // the last update is not on the chain yet
+#define WS2812_LATE_DMA         0x04    // the last refresh is still streaming
+#define WS2812_LATE_GAP         0x08    // the last refresh has not had its reset period
+
+/* The trace ring, a power of 2 events. Writers take a slot each with one 
+ * atomic add, ll / sc on the PIC32, so the main loop, the core timer service
+ * and the DMA interrupt can all write without locking; the oldest events are
+ * written over. */
+typedef struct _WS2812TRACE
+{
+    WS2812EVENT *       pEvents;
+    uint32_t            mask;           // events - 1
+    volatile uint32_t   cWritten;       // events ever written, the next goes at cWritten & mask
+    volatile uint8_t    fHold;          // dumpTrace() is reading, events are dropped
+} WS2812TRACE;
+
+/* Puts an event in the ring, if there is one */
+static inline void TraceWS2812(WS2812TRACE * pTrace, uint32_t t, uint32_t event, uint32_t arg8, uint32_t arg)
+{
+    WS2812EVENT * pEvent;
+
+    if(pTrace == NULL || pTrace->fHold)
+    {
+        return;
+    }
+
+    pEvent          = &pTrace->pEvents[__sync_fetch_and_add(&pTrace->cWritten, 1) & pTrace->mask];
+    pEvent->t       = t;
+    pEvent->event   = (uint8_t) event;
+    pEvent->arg8    = (uint8_t) arg8;
+    pEvent->arg     = (uint16_t) arg;
+}
+
+/* The state CoreTimer.c keeps for one chain */
+typedef struct _WS2812HW
+{
+    uint8_t                 fInit;
+    uint8_t                 iSPI;           // SPIx, 2 for SPI2
+    uint8_t                 iDMA;           // DMA channel iDMA streams the pattern buffer, iDMA + 1 the reset cycle
+    volatile uint8_t        fUpdating;      // hold the refresh, the pattern buffer is being updated
+    volatile uint8_t        fPending;       // an update was committed and has not been sent
+    uint8_t                 fPush;          // send a committed update as soon as the chain is ready
+    uint8_t                 fNewFrame;      // the refresh going out has a new update
+    volatile uint8_t        fOut;           // the pattern DMA channel is done, at tOut
+    volatile uint8_t        fFrameBusy;     // an update was committed and is not on the chain yet
+    uint32_t                level;          // what the reset DMA channel streams, all 0s or all 1s when inverted
+    uint32_t                tLastRun;
+    uint32_t                tRefresh;       // core timer ticks between refreshes
+    uint32_t                tStart;         // when the last refresh started
+    uint32_t                tGap;           // the shortest time from the start of a refresh to the next
+    uint32_t                tOut;
+    uint32_t                tLatch;         // from the pattern DMA channel being done to the chain latching
+    uint32_t                spiClockRate;   // what the SPI shifts out at, SPIxBRG is set for it
+    uint32_t                fMode32;        // the SPI and DMA move words, the pattern buffer is in word order
+    PFNWS2812FRAMEDONE      pfnFrameDone;
+    void *                  pFrameDoneContext;
+    uint8_t * volatile      pSwap;          // double buffering: next pattern buffer for the pattern DMA channel
+    uint8_t                 fStream;        // the pattern buffer is a ring of two halves, refilled by pfnFill
+    uint8_t *               pRing;
+    uint32_t                cbHalf;
+    uint32_t                cbFrame;        // streaming: bytes in a refresh
+    uint32_t                cHalves;        // streaming: halves a refresh takes, the last may be part padding
+    uint32_t                ibFill;         // streaming: the next byte of the refresh to go into the ring
+    uint32_t                iHalfOut;       // streaming: halves of the refresh read by the DMA
+    PFNWS2812FILL           pfnFill;
+    void *                  pFillContext;
+    uint8_t                 fBehind;        // a refresh was due and not ready, since tDue
+    uint32_t                tDue;
+    uint32_t                cRefreshes;     // the WS2812STATS the driver keeps
+    uint32_t                cLate;
+    uint32_t                cSkipped;
+    uint32_t                tMaxLate;
+    uint64_t                tDMABusy;
+    uint32_t                cUnderruns;
+    WS2812TRACE *           pTrace;         // or NULL
+    struct _WS2812HW *      pNext;
+#if defined(WS2812_HOST)
+    void *                  pHost;          // the WS2812HostDriver simulating the SPI and DMA channels
+#endif
+} WS2812HW;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+    /* CoreTimer.c, the PIC32 SPI and DMA channels */
+    uint32_t InitWS2812(WS2812HW * pHW, uint32_t iSPI, uint32_t iDMA, uint8_t * pPatternBuffer, uint32_t cbPatternBuffer, uint32_t fInvert, uint32_t spiClockRate, uint32_t fMode32);
+    void EndWS2812(WS2812HW * pHW);
+
+    /* CoreTimer.c, the refresh logic, built for the PIC32 and WS2812_HOST alike */
+    void SetupWS2812(WS2812HW * pHW, uint8_t * pPatternBuffer, uint32_t cbPatternBuffer, uint32_t fInvert, uint32_t spiClockRate, uint32_t fMode32);
+    uint32_t ServiceWS2812(WS2812HW * pHW, uint32_t curTime);
+    void PatternDoneWS2812(WS2812HW * pHW);
+    void StreamWS2812(WS2812HW * pHW, uint32_t halves);
+    uint32_t StartUpdate(WS2812HW * pHW);
+    void EndUpdate(WS2812HW * pHW);
+    uint32_t StartSwapUpdate(WS2812HW * pHW);
+    void SwapUpdate(WS2812HW * pHW, uint8_t * pPatternBuffer);
+    void SetRefresh(WS2812HW * pHW, uint32_t tRefresh, uint32_t fPush);
+    void SetFrameDone(WS2812HW * pHW, PFNWS2812FRAMEDONE pfnFrameDone, void * pContext);
+    uint32_t SetStream(WS2812HW * pHW, uint32_t cbFrame, PFNWS2812FILL pfnFill, void * pContext);
+    uint32_t IsFrameBusy(WS2812HW * pHW);
+    uint32_t WaitFrame(WS2812HW * pHW, uint32_t cTicks);
+    void GetStatsWS2812(WS2812HW * pHW, WS2812STATS * pStats);
+    void ClearStatsWS2812(WS2812HW * pHW);
+    void SetTraceWS2812(WS2812HW * pHW, WS2812TRACE * pTrace);
+
+    /* What the refresh logic needs from the SPI and DMA channels of a chain,
+     * CoreTimer.c has the PIC32 ones and WS2812Host.cpp the simulated ones */
+    uint32_t TicksWS2812(WS2812HW * pHW);
+    uint32_t PatternOnWS2812(WS2812HW * pHW);
+    uint32_t ResetOnWS2812(WS2812HW * pHW);
+    void StartPatternWS2812(WS2812HW * pHW, uint8_t * pSwap);
+    void StopPatternWS2812(WS2812HW * pHW);
+    void RingWS2812(WS2812HW * pHW);
+    uint32_t SentWS2812(WS2812HW * pHW);
+    void KickWS2812(WS2812HW * pHW);
+#ifdef __cplusplus
+}
+
+/* What the update state machine needs from the hardware. The methods
+ * follow the CoreTimer.c functions of the same names. */
+class WS2812Driver {
+
+public:
+
+    /* Start refreshing the chain from pPatternBuffer on SPIx iSPI with DMA 
+     * channels iDMA and iDMA + 1, shifted out at spiClockRate, which is 
+     * pbClock() / 2 / a whole number. With fMode32 the SPI shifts 32 bit 
+     * words, each MSb first, so the pattern buffer is in word order. The 
+     * refresh is held until the first endUpdate() or swapUpdate(). */
+    virtual bool init(uint32_t iSPI, uint32_t iDMA, uint8_t * pPatternBuffer, uint32_t cbPatternBuffer, bool fInvert, uint32_t spiClockRate, bool fMode32) = 0;
+    virtual void end(void) = 0;
+
+    /* Single buffered: hold the refresh, true once the pattern buffer
+     * is not being streamed and may be written. */
+    virtual bool startUpdate(void) = 0;
+    virtual void endUpdate(void) = 0;
+
+    /* Double buffered: true once the last swapUpdate() buffer has been
+     * taken for refreshing, so the other buffer may be written. */
+    virtual bool startSwapUpdate(void) = 0;
+    virtual void swapUpdate(uint8_t * pPatternBuffer) = 0;
+
+    /* Refresh every tRefresh core timer ticks, and if fPush, send an update
+     * as soon as it is committed and the last refresh is out. */
+    virtual void setRefresh(uint32_t tRefresh, bool fPush) = 0;
+
+    /* pfnFrameDone is called with pContext when a committed update is on 
+     * the chain; until then isFrameBusy() is true. waitFrame() waits up to
+     * cTicks core timer ticks for it. */
+    virtual void setFrameDone(PFNWS2812FRAMEDONE pfnFrameDone, void * pContext) = 0;
+    virtual bool isFrameBusy(void) = 0;
+    virtual bool waitFrame(uint32_t cTicks) = 0;
+
+    /* Stream refreshes of cbFrame bytes through the pattern buffer given to
+     * init(), used as a ring of two halves that pfnFill refills as the DMA
+     * goes. Called after init() and before the first update. */
+    virtual bool setStream(uint32_t cbFrame, PFNWS2812FILL pfnFill, void * pContext) = 0;
+
+    /* How far into the pattern buffer the pattern DMA channel has read,
+     * 0 when it is not streaming a refresh */
+    virtual uint32_t cbSent(void) = 0;
+
+    /* The core timer count, for timing work against a budget */
+    virtual uint32_t ticks(void) = 0;
+
+    /* The peripheral bus clock the SPI clock is divided down from */
+    virtual uint32_t pbClock(void) = 0;
+
+    /* Fills in the refresh and DMA counters of pStats, the rest are left
+     * alone. clearStats() starts them over. */
+    virtual void getStats(WS2812STATS * pStats) = 0;
+    virtual void clearStats(void) = 0;
+
+    /* Puts the refresh and DMA events in pTrace as well, NULL to stop.
+     * init() stops it. */
+    virtual void setTrace(WS2812TRACE * pTrace) = 0;
+};
+
+#if !defined(WS2812_HOST)
+/* A SPI and DMA channel pair, see CoreTimer.c */
+class WS2812Pic32Driver : public WS2812Driver {
+
+public:
+
+    WS2812Pic32Driver()                         { memset(&_hw, 0, sizeof(_hw)); }
+
+    bool init(uint32_t iSPI, uint32_t iDMA, uint8_t * pPatternBuffer, uint32_t cbPatternBuffer, bool fInvert, uint32_t spiClockRate, bool fMode32)
+    {
+        return(InitWS2812(&_hw, iSPI, iDMA, pPatternBuffer, cbPatternBuffer, fInvert, spiClockRate, fMode32) != 0);
+    }
+    void end(void)                              { EndWS2812(&_hw); }
+    bool startUpdate(void)                      { return(StartUpdate(&_hw) != 0); }
+    void endUpdate(void)                        { EndUpdate(&_hw); }
+    bool startSwapUpdate(void)                  { return(StartSwapUpdate(&_hw) != 0); }
+    void swapUpdate(uint8_t * pPatternBuffer)   { SwapUpdate(&_hw, pPatternBuffer); }
+    void setRefresh(uint32_t tRefresh, bool fPush)  { SetRefresh(&_hw, tRefresh, fPush); }
+    void setFrameDone(PFNWS2812FRAMEDONE pfnFrameDone, void * pContext)
+    {
+        SetFrameDone(&_hw, pfnFrameDone, pContext);
+    }
+    bool isFrameBusy(void)                      { return(IsFrameBusy(&_hw) != 0); }
+    bool waitFrame(uint32_t cTicks)             { return(WaitFrame(&_hw, cTicks) != 0); }
+    bool setStream(uint32_t cbFrame, PFNWS2812FILL pfnFill, void * pContext)
+    {
+        return(SetStream(&_hw, cbFrame, pfnFill, pContext) != 0);
+    }
+    uint32_t cbSent(void)                       { return(SentWS2812(&_hw)); }
+    uint32_t ticks(void)                        { uint32_t t; read_count(t); return(t); }
+    uint32_t pbClock(void)                      { return(__PIC32_pbClk); }
+    void getStats(WS2812STATS * pStats)         { GetStatsWS2812(&_hw, pStats); }
+    void clearStats(void)                       { ClearStatsWS2812(&_hw); }
+    void setTrace(WS2812TRACE * pTrace)         { SetTraceWS2812(&_hw, pTrace); }
+
+private:
+
+    WS2812HW    _hw;
+};
+#endif
+
+#if defined(WS2812_HOST)
+/* The refresh logic in CoreTimer.c on a simulated SPI and DMA channel pair,
+ * time only moves when advance() is called */
+class WS2812HostDriver : public WS2812Driver {
+
+public:
+
+    WS2812HostDriver();
+
+    bool init(uint32_t iSPI, uint32_t iDMA, uint8_t * pPatternBuffer, uint32_t cbPatternBuffer, bool fInvert, uint32_t spiClockRate, bool fMode32);
+    void end(void);
+    bool startUpdate(void)                      { return(StartUpdate(&_hw) != 0); }
+    void endUpdate(void)                        { EndUpdate(&_hw); }
+    bool startSwapUpdate(void)                  { return(StartSwapUpdate(&_hw) != 0); }
+    void swapUpdate(uint8_t * pPatternBuffer)   { SwapUpdate(&_hw, pPatternBuffer); }
+    void setRefresh(uint32_t tRefresh, bool fPush)  { SetRefresh(&_hw, tRefresh, fPush); }
+    void setFrameDone(PFNWS2812FRAMEDONE pfnFrameDone, void * pContext)
+    {
+        SetFrameDone(&_hw, pfnFrameDone, pContext);
+    }
+    bool isFrameBusy(void)                      { return(IsFrameBusy(&_hw) != 0); }
+    bool waitFrame(uint32_t cTicks);
+    bool setStream(uint32_t cbFrame, PFNWS2812FILL pfnFill, void * pContext)
+    {
+        return(SetStream(&_hw, cbFrame, pfnFill, pContext) != 0);
+    }
+    uint32_t cbSent(void)                       { return(SentWS2812(&_hw)); }
+    uint32_t ticks(void)                        { return(_pfnClock != NULL ? _pfnClock() : _tNow); }
+    uint32_t pbClock(void)                      { return(_pbClock); }
+    void getStats(WS2812STATS * pStats)         { GetStatsWS2812(&_hw, pStats); }
+    void clearStats(void)                       { ClearStatsWS2812(&_hw); }
+    void setTrace(WS2812TRACE * pTrace)         { SetTraceWS2812(&_hw, pTrace); }
+
+    void        setCapture(uint8_t * pCapture, uint32_t cbCapture);
+    void        setClock(uint32_t (* pfnClock)(void))   { _pfnClock = pfnClock; }
+    void        setPbClock(uint32_t pbClock)            { _pbClock = pbClock; }
+    void        setInterruptLatency(uint32_t cTicks)    { _tLatency = cTicks; }
+    void        advance(uint32_t cTicks);
+    uint32_t    now(void)           { return(_tNow); }
+    bool        isStreaming(void)   { return(_fPatOn); }
+    uint32_t    cRefreshes(void)    { return(_cTransfers); }
+    uint32_t    cbCaptured(void)    { return(_cbCaptured); }
+    uint8_t *   streamBuffer(void)  { return(_pSrc); }
+
+private:
+
+    WS2812HW    _hw;
+    bool        _fPatOn;            // the pattern DMA channel is enabled, DCHxCON CHEN
+    bool        _fRing;             // it goes round the ring interrupting each half, see RingWS2812()
+    uint8_t *   _pSrc;              // DCHxSSA
+    uint32_t    _cbSrc;             // DCHxSSIZ
+    uint32_t    _ibRead;            // bytes read since it was enabled, DCHxSPTR before it wraps
+    uint32_t    _tOn;               // when it was enabled
+    uint32_t    _cTransfers;        // times it has finished or been aborted
+    uint32_t    _flags;             // WS2812_RING_HALF0 / 1, or 1 for the block done, waiting on the interrupt
+    uint32_t    _tInterrupt;        // when the interrupt runs for them
+    uint32_t    _tLatency;          // from a flag being set to the interrupt running
+    uint32_t    _tNow;
+    uint32_t    (* _pfnClock)(void);    // what ticks() reads, NULL for _tNow
+    uint32_t    _tService;          // when the core timer service runs next
+    uint32_t    _pbClock;           // __PIC32_pbClk
+    uint8_t *   _pCapture;
+    uint32_t    _cbCapture;
+    uint32_t    _cbCaptured;
+
+    uint32_t    cbNextInterrupt(void);
+    uint32_t    tRead(uint32_t cb);
+    void        read(uint32_t cb);
+    void        flag(void);
+    void        interrupt(void);
+
+    friend uint32_t PatternOnWS2812(WS2812HW * pHW);
+    friend uint32_t ResetOnWS2812(WS2812HW * pHW);
+    friend uint32_t TicksWS2812(WS2812HW * pHW);
+    friend void StartPatternWS2812(WS2812HW * pHW, uint8_t * pSwap);
+    friend void StopPatternWS2812(WS2812HW * pHW);
+    friend void RingWS2812(WS2812HW * pHW);
+    friend uint32_t SentWS2812(WS2812HW * pHW);
+    friend void KickWS2812(WS2812HW * pHW);
+};
+#endif
+
+#if defined(WS2812_HOST)
+typedef WS2812HostDriver    WS2812PlatformDriver;
+#else
+typedef WS2812Pic32Driver   WS2812PlatformDriver;
+#endif
+
+#endif // __cplusplus
+
+#endif // _WS2812DRIVER_H
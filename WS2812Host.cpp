@@ -0,0 +1,412 @@
+/************************************************************************/
+/*                                                                      */
+/*    WS2812Host.cpp                                                    */
+/*                                                                      */
+/*    A simulated SPI / DMA driver so the WS2812 library can be run     */
+/*    and checked off target                                            */
+/*                                                                      */
+/************************************************************************/
+/*
+*
+* Copyright (c) 2014, Digilent <www.digilentinc.com>
+* Contact Digilent for the latest version.
+*
+* This program is free software; distributed under the terms of
+* BSD 3-clause license ("Revised BSD License", "New BSD License", or "Modified BSD License")
+*
+* Redistribution and use in source and binary forms, with or without modification,
+* are permitted provided that the following conditions are met:
+*
+* 1.    Redistributions of source code must retain the above copyright notice, this
+*        list of conditions and the following disclaimer.
+* 2.    Redistributions in binary form must reproduce the above copyright notice,
+*        this list of conditions and the following disclaimer in the documentation
+*        and/or other materials provided with the distribution.
+* 3.    Neither the name(s) of the above-listed copyright holder(s) nor the names
+*        of its contributors may be used to endorse or promote products derived
+*        from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+* IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+* BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+* LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/************************************************************************/
+/*                                                                      */
+/*  The SPI and DMA channel routines CoreTimer.c's refresh logic runs   */
+/*  on, for one simulated chain. The pattern DMA channel reads a byte   */
+/*  every 8 SPI clocks once the SPI FIFO is full, interrupting at the   */
+/*  end of the pattern buffer, or of each half of a streaming ring; the */
+/*  rest of the time the reset channel streams the reset level, which   */
+/*  is not captured. It is only built with WS2812_HOST defined, so a    */
+/*  sketch does not carry it.                                           */
+/*                                                                      */
+/************************************************************************/
+#if defined(WS2812_HOST)
+
+#include <WS2812Driver.h>
+
+#define TICKSPERSECOND  (1000ull * CORE_TICK_RATE)
+
+#define HOST(__pHW)     ((WS2812HostDriver *) (__pHW)->pHost)
+
+WS2812HostDriver::WS2812HostDriver()
+{
+    memset(&_hw, 0, sizeof(_hw));
+    _hw.pHost   = this;
+    _fPatOn     = false;
+    _fRing      = false;
+    _pSrc       = NULL;
+    _cbSrc      = 0;
+    _ibRead     = 0;
+    _tOn        = 0;
+    _cTransfers = 0;
+    _flags      = 0;
+    _tInterrupt = 0;
+    _tLatency   = 0;
+    _tNow       = 0;
+    _pfnClock   = NULL;
+    _tService   = 0;
+    _pbClock    = WS2812_HOST_PBCLK;
+    _pCapture   = NULL;
+    _cbCapture  = 0;
+    _cbCaptured = 0;
+}
+
+/***    bool WS2812HostDriver::init(uint32_t iSPI, uint32_t iDMA, uint8_t * pPatternBuffer, uint32_t cbPatternBuffer, bool fInvert, uint32_t spiClockRate, bool fMode32)
+ *
+ *    Description:
+ *
+ *      As InitWS2812(), the refresh is held until the first update completes.
+ *      Every host driver has its own simulated SPI and DMA, so iSPI and iDMA
+ *      are not used.
+ *
+ * ------------------------------------------------------------ */
+bool WS2812HostDriver::init(uint32_t /* iSPI */, uint32_t /* iDMA */, uint8_t * pPatternBuffer, uint32_t cbPatternBuffer, bool fInvert, uint32_t spiClockRate, bool fMode32)
+{
+    if(_hw.fInit || spiClockRate > _pbClock / 2 || spiClockRate < _pbClock / WS2812_MAX_SPI_DIVIDER ||
+       (fMode32 && (((uintptr_t) pPatternBuffer & 3) != 0 || (cbPatternBuffer & 3) != 0)))
+    {
+        return(false);
+    }
+
+    _fPatOn     = false;
+    _fRing      = false;
+    _pSrc       = pPatternBuffer;
+    _cbSrc      = cbPatternBuffer;
+    _ibRead     = 0;
+    _cTransfers = 0;
+    _flags      = 0;
+    _cbCaptured = 0;
+
+    SetupWS2812(&_hw, pPatternBuffer, cbPatternBuffer, fInvert, spiClockRate, fMode32);
+    _tService   = _tNow;
+    _hw.fInit   = true;
+    return(true);
+}
+
+/***    void WS2812HostDriver::end(void)
+ *
+ *    Description:
+ *
+ *      As EndWS2812(), the simulated channels are stopped.
+ *
+ * ------------------------------------------------------------ */
+void WS2812HostDriver::end(void)
+{
+    _fPatOn         = false;
+    _fRing          = false;
+    _flags          = 0;
+    _hw.fStream     = false;
+    _hw.fInit       = false;
+}
+
+/***    bool WS2812HostDriver::waitFrame(uint32_t cTicks)
+ *
+ *    Description:
+ *
+ *      As WaitFrame(), time is advanced while waiting.
+ *
+ * ------------------------------------------------------------ */
+bool WS2812HostDriver::waitFrame(uint32_t cTicks)
+{
+    uint32_t tStart = _tNow;
+
+    while(_hw.fFrameBusy && _hw.fInit)
+    {
+        if(_tNow - tStart >= cTicks)
+        {
+            return(false);
+        }
+        advance(TICKSPERSHORTCHECK / 50);
+    }
+
+    return(!_hw.fFrameBusy);
+}
+
+/***    void WS2812HostDriver::setCapture(uint8_t * pCapture, uint32_t cbCapture)
+ *
+ *    Parameters:
+ *          pCapture:   Where to put the bytes the pattern DMA channel reads, or NULL
+ *
+ *          cbCapture:  The size of pCapture, bytes past this are not kept
+ *
+ *    Return Values:
+ *          None
+ *
+ *    Description:
+ *
+ *      Each refresh starts over at the start of pCapture, and bytes are
+ *      copied as the simulated DMA reads them into the SPI, so pCapture
+ *      holds what the chain was sent, even if the pattern buffer changes
+ *      part way through a refresh. cbCaptured() is how far it has got.
+ *
+ * ------------------------------------------------------------ */
+void WS2812HostDriver::setCapture(uint8_t * pCapture, uint32_t cbCapture)
+{
+    _pCapture   = pCapture;
+    _cbCapture  = cbCapture;
+    _cbCaptured = 0;
+}
+
+/***    void WS2812HostDriver::advance(uint32_t cTicks)
+ *
+ *    Parameters:
+ *          cTicks: How many core timer ticks to move time forward
+ *
+ *    Return Values:
+ *          None
+ *
+ *    Description:
+ *
+ *      Runs the core timer service and the DMA transfers and
+ *      interrupts that happen in the next cTicks ticks. The DMA 
+ *      interrupt runs setInterruptLatency() ticks after its flag is 
+ *      set, the channel going on meanwhile.
+ *
+ * ------------------------------------------------------------ */
+void WS2812HostDriver::advance(uint32_t cTicks)
+{
+    uint32_t tEnd = _tNow + cTicks;
+
+    while(_hw.fInit)
+    {
+        uint32_t    tNext   = _tService;
+        uint32_t    event   = 0;
+
+        if(_fPatOn && (int32_t) (tRead(cbNextInterrupt()) - tNext) <= 0)
+        {
+            tNext   = tRead(cbNextInterrupt());
+            event   = 1;
+        }
+
+        if(_flags != 0 && (int32_t) (_tInterrupt - tNext) <= 0)
+        {
+            tNext   = _tInterrupt;
+            event   = 2;
+        }
+
+        if((int32_t) (tNext - tEnd) > 0)
+        {
+            break;
+        }
+
+        _tNow = tNext;
+        if(event == 1)
+        {
+            read(cbNextInterrupt());
+            flag();
+        }
+        else if(event == 2)
+        {
+            interrupt();
+        }
+        else
+        {
+            _tService = ServiceWS2812(&_hw, _tNow);
+        }
+    }
+
+    _tNow = tEnd;
+    if(_fPatOn)
+    {
+        uint64_t cb = CBSPIFIFO + (((uint64_t) (_tNow - _tOn) * _hw.spiClockRate) / (8 * TICKSPERSECOND));
+
+        read(cb < cbNextInterrupt() ? (uint32_t) cb : cbNextInterrupt());
+    }
+}
+
+/***    uint32_t WS2812HostDriver::cbNextInterrupt(void)
+ *
+ *    Return Values:
+ *          How far the pattern DMA channel reads before it next 
+ *          interrupts, the end of the pattern buffer or of a ring half
+ *
+ * ------------------------------------------------------------ */
+uint32_t WS2812HostDriver::cbNextInterrupt(void)
+{
+    if(_fRing)
+    {
+        return(((_ibRead / _hw.cbHalf) + 1) * _hw.cbHalf);
+    }
+
+    return(_cbSrc);
+}
+
+/***    uint32_t WS2812HostDriver::tRead(uint32_t cb)
+ *
+ *    Return Values:
+ *          When the pattern DMA channel has read cb bytes. It fills the 
+ *          SPI FIFO as soon as it is enabled, then keeps it topped up
+ *          as the SPI shifts a byte out every 8 SPI clocks.
+ *
+ * ------------------------------------------------------------ */
+uint32_t WS2812HostDriver::tRead(uint32_t cb)
+{
+    if(cb <= CBSPIFIFO)
+    {
+        return(_tOn);
+    }
+
+    return(_tOn + (uint32_t) ((((uint64_t) (cb - CBSPIFIFO)) * 8 * TICKSPERSECOND + _hw.spiClockRate - 1) / _hw.spiClockRate));
+}
+
+/***    void WS2812HostDriver::read(uint32_t cb)
+ *
+ *    Description:
+ *
+ *      Moves the pattern DMA channel on to cb bytes read since it was 
+ *      enabled, capturing the bytes; round the ring when streaming.
+ *
+ * ------------------------------------------------------------ */
+void WS2812HostDriver::read(uint32_t cb)
+{
+    for(; _ibRead < cb; _ibRead++)
+    {
+        uint32_t ib = _ibRead % _cbSrc;
+
+        if(_pCapture != NULL && _cbCaptured < _cbCapture)
+        {
+            // in MODE32 each word goes out MSb first, its last byte first
+            _pCapture[_cbCaptured++] = _pSrc[_hw.fMode32 ? (ib ^ 3) : ib];
+        }
+    }
+}
+
+/***    void WS2812HostDriver::flag(void)
+ *
+ *    Description:
+ *
+ *      Sets the pattern DMA channel's half way or block done flag, the
+ *      channel has just read to cbNextInterrupt(). At the end of the 
+ *      pattern buffer the chained reset channel takes over.
+ *
+ * ------------------------------------------------------------ */
+void WS2812HostDriver::flag(void)
+{
+    if(_flags == 0)
+    {
+        _tInterrupt = _tNow + _tLatency;
+    }
+
+    if(_fRing)
+    {
+        _flags |= ((_ibRead / _hw.cbHalf) & 1) != 0 ? WS2812_RING_HALF0 : WS2812_RING_HALF1;
+    }
+    else
+    {
+        _flags  = 1;
+        _fPatOn = false;
+        _cTransfers++;
+    }
+}
+
+/***    void WS2812HostDriver::interrupt(void)
+ *
+ *    Description:
+ *
+ *      The pattern DMA channel interrupt, see WS2812DMAService().
+ *
+ * ------------------------------------------------------------ */
+void WS2812HostDriver::interrupt(void)
+{
+    uint32_t flags = _flags;
+
+    _flags = 0;
+    if(_fRing)
+    {
+        StreamWS2812(&_hw, flags);
+    }
+    else
+    {
+        PatternDoneWS2812(&_hw);
+    }
+}
+
+/************************************************************************/
+/*                                                                      */
+/*  The simulated SPI and DMA channels, see CoreTimer.c                 */
+/*                                                                      */
+/************************************************************************/
+
+uint32_t TicksWS2812(WS2812HW * pHW)
+{
+    return(HOST(pHW)->_tNow);
+}
+
+uint32_t PatternOnWS2812(WS2812HW * pHW)
+{
+    return(HOST(pHW)->_fPatOn);
+}
+
+uint32_t ResetOnWS2812(WS2812HW * pHW)
+{
+    return(!HOST(pHW)->_fPatOn);
+}
+
+void StartPatternWS2812(WS2812HW * pHW, uint8_t * pSwap)
+{
+    WS2812HostDriver * pHost = HOST(pHW);
+
+    if(pSwap != NULL)
+    {
+        pHost->_pSrc = pSwap;
+    }
+    pHost->_fPatOn      = true;
+    pHost->_tOn         = pHost->_tNow;
+    pHost->_ibRead      = 0;
+    pHost->_flags       = 0;
+    pHost->_cbCaptured  = 0;
+}
+
+void StopPatternWS2812(WS2812HW * pHW)
+{
+    HOST(pHW)->_fPatOn = false;
+    HOST(pHW)->_cTransfers++;
+}
+
+void RingWS2812(WS2812HW * pHW)
+{
+    HOST(pHW)->_fRing   = true;
+    HOST(pHW)->_cbSrc   = 2 * pHW->cbHalf;
+}
+
+uint32_t SentWS2812(WS2812HW * pHW)
+{
+    WS2812HostDriver * pHost = HOST(pHW);
+
+    return(pHost->_fPatOn ? pHost->_ibRead % pHost->_cbSrc : 0);
+}
+
+void KickWS2812(WS2812HW * pHW)
+{
+    HOST(pHW)->_tService = ServiceWS2812(pHW, HOST(pHW)->_tNow);
+}
+
+#endif // WS2812_HOST
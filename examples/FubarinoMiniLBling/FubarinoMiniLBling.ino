@@ -56,9 +56,10 @@
 /*  chipKIT Max32 Dout pin 43 or (51 with JP4 in master);               */
 /*          unusable pins 29,50,52                                      */
 /*  Fubarino SD 1.5 Dout pin 26                                         */
-/*  WARNING: currently this code assumes SPI2. Of the chipKIT boards    */
-/*  this works on (WF32/Max32), the standard Arduino SPI just happens   */
-/*  to always be SPI2, but this is NOT generalized code!                */
+/*  By default this uses SPI2 and DMA channels 0 and 1. Of the chipKIT  */
+/*  boards this works on, the standard Arduino SPI just happens to      */
+/*  be SPI2. begin() can pick another SPI and DMA channel pair, so      */
+/*  several chains can each refresh on their own SPI at the same time.  */
 /*                                                                      */
 /*  The spec says that Dout Vih = .7Vdd and Vdd = 6v-7v However...      */
 /*  it seems to work with Vdd == 4.5v -> 5v and Vih == 3.3              */
@@ -142,7 +143,7 @@ uint32_t    led     = HIGH;
 int count = 0;
 
 WS2812      ws2812;
-uint8_t     rgbPatternBuffer[CBWS2812PATBUF(CDEVICES)];
+uint8_t     rgbPatternBuffer[CBWS2812PATBUF(CDEVICES)] WS2812_ALIGNED;
 
 typedef enum {
     LOADPAT,
@@ -56,9 +56,10 @@
 /*  chipKIT Max32 Dout pin 43 or (51 with JP4 in master);               */
 /*          unusable pins 29,50,52                                      */
 /*  Fubarino SD 1.5 Dout pin 26                                         */
-/*  WARNING: currently this code assumes SPI2. Of the chipKIT boards    */
-/*  this works on (WF32/Max32), the standard Arduino SPI just happens   */
-/*  to always be SPI2, but this is NOT generalized code!                */
+/*  By default this uses SPI2 and DMA channels 0 and 1. Of the chipKIT  */
+/*  boards this works on, the standard Arduino SPI just happens to      */
+/*  be SPI2. begin() can pick another SPI and DMA channel pair, so      */
+/*  several chains can each refresh on their own SPI at the same time.  */
 /*                                                                      */
 /*  The spec says that Dout Vih = .7Vdd and Vdd = 6v-7v However...      */
 /*  it seems to work with Vdd == 4.5v -> 5v and Vih == 3.3              */
@@ -100,11 +101,11 @@ uint32_t    tStart  = 0;
 uint32_t    led     = HIGH;
 
 WS2812      ws2812;
-uint8_t     rgbPatternBuffer[CBWS2812PATBUF(CDEVICES)];
+uint8_t     rgbPatternBuffer[CBWS2812PATBUF(CDEVICES)] WS2812_ALIGNED;
 
 typedef enum {
     LOADPAT,
-    SHIFT,
+    SCROLL,
     WAIT,
     SPIN
 } STATE;
@@ -161,32 +162,28 @@ void setup()
  * ------------------------------------------------------------ */
 void loop() 
 {
-    WS2812::GRB grbT;
-
     switch(state)
     {
         case LOADPAT:
             if(ws2812.updateLEDs(rgGRB))
             {
-                state = SHIFT;
+                state = WAIT;
             }
             break;
 
-        case SHIFT:
-            memcpy(&grbT, &rgGRB[CDEVICES-1], sizeof(WS2812::GRB));
-            for(int i = CDEVICES-2; i>=0; i--)
+        // rotate the chain one device, without converting the pattern again
+        case SCROLL:
+            if(ws2812.scrollLEDs(1))
             {
-                memcpy(&rgGRB[i+1], &rgGRB[i], sizeof(WS2812::GRB));
+                state = WAIT;
             }
-            memcpy(&rgGRB[0], &grbT, sizeof(WS2812::GRB));
-            state = WAIT;
             break;
 
         case WAIT:
             if(millis() - tWaitShift >= MSSHIFT)
             {
                 tWaitShift = millis();
-                state = LOADPAT;
+                state = SCROLL;
             }
             break;
 
@@ -0,0 +1,205 @@
+/************************************************************************/
+/*                                                                      */
+/*    WS2812Bench.cpp                                                   */
+/*                                                                      */
+/*    Times updateLEDs() on the host across chain lengths, bit          */
+/*    timings, inversion and cPass                                      */
+/*                                                                      */
+/************************************************************************/
+/*
+*
+* Copyright (c) 2014, Digilent <www.digilentinc.com>
+* Contact Digilent for the latest version.
+*
+* This program is free software; distributed under the terms of
+* BSD 3-clause license ("Revised BSD License", "New BSD License", or "Modified BSD License")
+*
+* Redistribution and use in source and binary forms, with or without modification,
+* are permitted provided that the following conditions are met:
+*
+* 1.    Redistributions of source code must retain the above copyright notice, this
+*        list of conditions and the following disclaimer.
+* 2.    Redistributions in binary form must reproduce the above copyright notice,
+*        this list of conditions and the following disclaimer in the documentation
+*        and/or other materials provided with the distribution.
+* 3.    Neither the name(s) of the above-listed copyright holder(s) nor the names
+*        of its contributors may be used to endorse or promote products derived
+*        from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+* IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+* BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+* LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/************************************************************************/
+/*                                                                      */
+/*  Runs the real WS2812.cpp update state machine and encoders against  */
+/*  WS2812HostDriver. The host driver is never advanced, so an update   */
+/*  never waits on a refresh and only the converting is timed.          */
+/*                                                                      */
+/*  From the library folder:                                            */
+/*                                                                      */
+/*    g++ -std=gnu++11 -O2 -DWS2812_HOST -I. CoreTimer.c WS2812.cpp     */
+/*        WS2812Host.cpp extras/host/WS2812Bench.cpp -o WS2812Bench     */
+/*    ./WS2812Bench [ms per case] > bench.csv                           */
+/*                                                                      */
+/*  Writes one CSV line per case to stdout:                             */
+/*                                                                      */
+/*    encoder       fixed (compile time table) or table (run time)      */
+/*    devices       chain length                                        */
+/*    width,high1,high0  bit timing in SPI clocks                       */
+/*    invert        fInvert                                             */
+/*    lut           1 with color tables (brightness / gamma) in use     */
+/*    pass          cPass, 0 is the whole chain in one call             */
+/*    frames,calls  full updates run and updateLEDs() calls made        */
+/*    pixels_per_s  devices converted per second of updateLEDs()        */
+/*    ns_per_pixel  time in updateLEDs() per device                     */
+/*    ns_call_mean  mean time of one updateLEDs() call                  */
+/*    ns_call_max   worst time of one updateLEDs() call                 */
+/*                                                                      */
+/************************************************************************/
+#include <WS2812.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+typedef std::chrono::steady_clock CLOCK;
+
+static const uint32_t rgcDevices[]  = { 1, 8, 30, 60, 144, 300, 600, 1000, 2000 };
+static const uint32_t rgcPass[]     = { 1, 5, 30, 0 };
+static const uint16_t rgTiming[][3] =
+{
+    { WS2812_DEFAULT_BIT_WIDTH_CLKS, WS2812_DEFAULT_BIT_1_HIGH_CLKS, WS2812_DEFAULT_BIT_0_HIGH_CLKS },
+    { 4, 3, 1 },
+    { 3, 2, 1 }
+};
+
+#define ELEMENTS(__rg) (sizeof(__rg) / sizeof(__rg[0]))
+
+static uint8_t          rgbPatternBuffer[CBWS2812PATBUF(2000)] WS2812_ALIGNED;
+static uint8_t          rgbColorLUT[CBWS2812COLORLUT(WS2812::GRB)];
+static WS2812::GRB      rgGRB[2000];
+
+/***    static void bench(uint32_t cDevices, const uint16_t timing[3], bool fInvert, bool fLUT, uint32_t cPass, uint32_t msCase)
+ *
+ *    Parameters:
+ *          cDevices:   The chain length
+ *
+ *          timing:     Bit width, 1 high and 0 high in SPI clocks
+ *
+ *          fInvert:    The fInvert to give begin()
+ *
+ *          fLUT:       Use color tables, half brightness and a 2.2 gamma
+ *
+ *          cPass:      The cPass to give updateLEDs(), 0 for the whole chain
+ *
+ *          msCase:     About how long to run the case for
+ *
+ *    Return Values:
+ *          None
+ *
+ *    Description:
+ *
+ *      Runs full updates until msCase has gone by and prints the CSV line.
+ *      The colors change every frame, outside of the timed calls.
+ *
+ * ------------------------------------------------------------ */
+static void bench(uint32_t cDevices, const uint16_t timing[3], bool fInvert, bool fLUT, uint32_t cPass, uint32_t msCase)
+{
+    WS2812          ws2812;
+    uint64_t        nsTotal     = 0;
+    uint64_t        nsMax       = 0;
+    uint64_t        cCalls      = 0;
+    uint64_t        cFrames     = 0;
+    uint32_t        color       = 0x123456;
+    CLOCK::time_point tEnd      = CLOCK::now() + std::chrono::milliseconds(msCase);
+    bool            fFixed      = (timing[0] == WS2812_DEFAULT_BIT_WIDTH_CLKS && timing[1] == WS2812_DEFAULT_BIT_1_HIGH_CLKS && timing[2] == WS2812_DEFAULT_BIT_0_HIGH_CLKS);
+
+    if(!ws2812.begin(cDevices, rgbPatternBuffer, sizeof(rgbPatternBuffer), fInvert, timing[0], timing[1], timing[2]))
+    {
+        fprintf(stderr, "begin() failed for %u devices %u/%u/%u\n", cDevices, timing[0], timing[1], timing[2]);
+        return;
+    }
+
+    if(fLUT)
+    {
+        ws2812.setBrightness(128);
+        ws2812.setGamma(2.2f);
+        ws2812.setColorTables(rgbColorLUT, sizeof(rgbColorLUT));
+    }
+
+    do
+    {
+        bool fDone = false;
+
+        for(uint32_t i = 0; i < cDevices; i++)
+        {
+            color           = color * 1103515245 + 12345;
+            rgGRB[i].green  = (uint8_t) (color >> 8);
+            rgGRB[i].red    = (uint8_t) (color >> 16);
+            rgGRB[i].blue   = (uint8_t) (color >> 24);
+        }
+
+        while(!fDone)
+        {
+            CLOCK::time_point   tStart  = CLOCK::now();
+            uint64_t            ns      = 0;
+
+            fDone = ws2812.updateLEDs(rgGRB, (cPass == 0) ? cDevices : cPass);
+            ns = std::chrono::duration_cast<std::chrono::nanoseconds>(CLOCK::now() - tStart).count();
+
+            nsTotal += ns;
+            if(ns > nsMax)
+            {
+                nsMax = ns;
+            }
+            cCalls++;
+        }
+
+        cFrames++;
+    } while(CLOCK::now() < tEnd);
+
+    ws2812.end();
+
+    printf("%s,%u,%u,%u,%u,%u,%u,%u,%llu,%llu,%.0f,%.2f,%.1f,%llu\n",
+        fFixed ? "fixed" : "table",
+        cDevices, timing[0], timing[1], timing[2], fInvert, fLUT, cPass,
+        (unsigned long long) cFrames, (unsigned long long) cCalls,
+        (cFrames * cDevices * 1e9) / (double) nsTotal,
+        nsTotal / (double) (cFrames * cDevices),
+        nsTotal / (double) cCalls,
+        (unsigned long long) nsMax);
+    fflush(stdout);
+}
+
+int main(int argc, char * argv[])
+{
+    uint32_t msCase = (argc > 1) ? (uint32_t) atoi(argv[1]) : 50;
+
+    printf("encoder,devices,width,high1,high0,invert,lut,pass,frames,calls,pixels_per_s,ns_per_pixel,ns_call_mean,ns_call_max\n");
+
+    for(uint32_t iTiming = 0; iTiming < ELEMENTS(rgTiming); iTiming++)
+    {
+        for(uint32_t fInvert = 0; fInvert < 2; fInvert++)
+        {
+            for(uint32_t fLUT = 0; fLUT < 2; fLUT++)
+            {
+                for(uint32_t iDevices = 0; iDevices < ELEMENTS(rgcDevices); iDevices++)
+                {
+                    for(uint32_t iPass = 0; iPass < ELEMENTS(rgcPass); iPass++)
+                    {
+                        bench(rgcDevices[iDevices], rgTiming[iTiming], fInvert != 0, fLUT != 0, rgcPass[iPass], msCase);
+                    }
+                }
+            }
+        }
+    }
+
+    return(0);
+}
@@ -0,0 +1,878 @@
+/************************************************************************/
+/*                                                                      */
+/*    WS2812Test.cpp                                                    */
+/*                                                                      */
+/*    Checks every encoder and update against WS2812Decoder on the      */
+/*    host                                                              */
+/*                                                                      */
+/************************************************************************/
+/*
+*
+* Copyright (c) 2014, Digilent <www.digilentinc.com>
+* Contact Digilent for the latest version.
+*
+* This program is free software; distributed under the terms of
+* BSD 3-clause license ("Revised BSD License", "New BSD License", or "Modified BSD License")
+*
+* Redistribution and use in source and binary forms, with or without modification,
+* are permitted provided that the following conditions are met:
+*
+* 1.    Redistributions of source code must retain the above copyright notice, this
+*        list of conditions and the following disclaimer.
+* 2.    Redistributions in binary form must reproduce the above copyright notice,
+*        this list of conditions and the following disclaimer in the documentation
+*        and/or other materials provided with the distribution.
+* 3.    Neither the name(s) of the above-listed copyright holder(s) nor the names
+*        of its contributors may be used to endorse or promote products derived
+*        from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+* IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+* BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+* LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/************************************************************************/
+/*                                                                      */
+/*  Runs random frames through each encoder and kind of update, and     */
+/*  decodes what WS2812HostDriver captured on SDO back into devices.    */
+/*  A case passes if every frame decodes to what the sketch asked for   */
+/*  and every bit is inside the LED timings.                            */
+/*                                                                      */
+/*  From the library folder:                                            */
+/*                                                                      */
+/*    g++ -std=gnu++11 -O2 -DWS2812_HOST -I. CoreTimer.c WS2812.cpp     */
+/*        WS2812Host.cpp WS2812Decode.cpp extras/host/WS2812Test.cpp    */
+/*        -o WS2812Test                                                 */
+/*    ./WS2812Test [seed]                                               */
+/*                                                                      */
+/*  Prints a line per chain and case, and exits with 1 if any failed.   */
+/*                                                                      */
+/************************************************************************/
+#include <WS2812Decode.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ELEMENTS(__rg) (sizeof(__rg) / sizeof(__rg[0]))
+
+#define CDEVICESMAX     60
+#define CPALETTE        16
+#define CFRAMES         20
+#define CEARLY          4                           // devices converted before an early start
+#define TICKSTEP        (CORE_TICK_RATE / 100)      // 10uS between calls
+#define TICKSTIMEOUT    (CORE_TICK_RATE * 1000)     // 1 second for a frame
+#define TICKSLATENCY    (TICKSPERREFRESH + (TICKSPERREFRESH / 4))   // a refresh period, then the refresh itself
+#define TICKSLATE       (CORE_TICK_RATE / 5)        // 200uS, more than a ring half of CDEVICESHALF takes
+#define CDEVICESHALF    2                           // devices in a ring half for CaseUnderrun()
+
+/* A chain to check, and how to begin it */
+typedef bool (* PFNBEGIN)(WS2812Core * pWS2812, uint32_t cDevices, uint8_t * pPatternBuffer, uint8_t * pPatternBuffer2, uint32_t cbPatternBuffer, bool fInvert, bool fStream);
+
+typedef struct _CHAIN
+{
+    const char *                    szName;
+    WS2812Core *                    pWS2812;
+    PFNBEGIN                        pfnBegin;
+    bool                            fInvert;
+    bool                            fMode32;
+    const WS2812Decoder::TIMING *   pTiming;    // the LED timings every bit must meet, NULL not to check
+} CHAIN;
+
+/* A kind of update, returns the frames that failed */
+typedef uint32_t (* PFNCASE)(const CHAIN& chain, uint32_t cDevices);
+
+static uint8_t          rgbPatternBuffer[CBWS2812PATBUF(CDEVICESMAX)] WS2812_ALIGNED;
+static uint8_t          rgbPatternBuffer2[CBWS2812PATBUF(CDEVICESMAX)] WS2812_ALIGNED;
+static uint8_t          rgbRing[CBWS2812RING(CDEVICESMAX)] WS2812_ALIGNED;
+static uint8_t          rgbSymbols[CBWS2812PALETTE(CPALETTE)] WS2812_ALIGNED;
+static uint8_t          rgbCapture[4 * CBWS2812RING(CDEVICESMAX)];
+static WS2812::GRB      rgGRB[CDEVICESMAX];
+static WS2812::GRB      rgExpected[CDEVICESMAX];
+static WS2812::GRB      rgDecoded[CDEVICESMAX];
+static WS2812::GRB      rgPalette[CPALETTE];
+static uint8_t          rgIndex[CDEVICESMAX];
+static uint32_t         randomState = 1;
+static bool             fFrameDone  = false;
+
+WS2812                  ws2812Table;
+WS2812                  ws2812Timing;
+WS2812                  ws2812TableInverted;
+WS2812                  ws2812TableMode32;
+WS2812T<>               ws2812Fixed;
+WS2812T<3, 2, 1>        ws2812Fixed3;
+WS2812T<>               ws2812FixedInverted;
+WS2812T<>               ws2812FixedMode32;
+
+/***    static uint32_t Random(void)
+ *
+ *    Return Values:
+ *          The next number from a 32 bit xorshift generator
+ *
+ * ------------------------------------------------------------ */
+static uint32_t Random(void)
+{
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return(randomState);
+}
+
+/***    static void RandomGRB(WS2812::GRB rgGRBOut[], uint32_t cDevices)
+ *
+ *    Parameters:
+ *          rgGRBOut:   Where to put the colors
+ *
+ *          cDevices:   How many to make
+ *
+ *    Return Values:
+ *          None
+ *
+ * ------------------------------------------------------------ */
+static void RandomGRB(WS2812::GRB rgGRBOut[], uint32_t cDevices)
+{
+    for(uint32_t i = 0; i < cDevices; i++)
+    {
+        uint32_t rgb = Random();
+
+        rgGRBOut[i].green   = (uint8_t) rgb;
+        rgGRBOut[i].red     = (uint8_t) (rgb >> 8);
+        rgGRBOut[i].blue    = (uint8_t) (rgb >> 16);
+    }
+}
+
+/***    static void FrameDone(WS2812Core * pWS2812, void * pContext)
+ *
+ *    Description:
+ *
+ *      The frame done callback of every chain, the last update is
+ *      now what the capture holds.
+ *
+ * ------------------------------------------------------------ */
+static void FrameDone(WS2812Core * /* pWS2812 */, void * /* pContext */)
+{
+    fFrameDone = true;
+}
+
+/***    static bool BeginTable(WS2812Core * pWS2812, uint32_t cDevices, uint8_t * pPatternBuffer, uint8_t * pPatternBuffer2,
+ *                             uint32_t cbPatternBuffer, bool fInvert, bool fStream)
+ *
+ *    Description:
+ *
+ *      Begins a WS2812 with timings that are not the default, so it
+ *      converts with the symbol table begin() builds.
+ *
+ * ------------------------------------------------------------ */
+static bool BeginTable(WS2812Core * pWS2812, uint32_t cDevices, uint8_t * pPatternBuffer, uint8_t * pPatternBuffer2, uint32_t cbPatternBuffer, bool fInvert, bool fStream)
+{
+    WS2812 * pThis = (WS2812 *) pWS2812;
+
+    if(fStream)
+    {
+        return(pThis->beginStream(cDevices, pPatternBuffer, cbPatternBuffer, fInvert, 4, 3, 1));
+    }
+
+    return(pThis->begin(cDevices, pPatternBuffer, pPatternBuffer2, cbPatternBuffer, fInvert, 4, 3, 1));
+}
+
+/***    static bool BeginTiming(WS2812Core * pWS2812, uint32_t cDevices, uint8_t * pPatternBuffer, uint8_t * pPatternBuffer2,
+ *                              uint32_t cbPatternBuffer, bool fInvert, bool fStream)
+ *
+ *    Description:
+ *
+ *      Begins a WS2812 from the WS2812B data sheet timings, so the SPI
+ *      clock and symbols are the ones pickTiming() chose.
+ *
+ * ------------------------------------------------------------ */
+static bool BeginTiming(WS2812Core * pWS2812, uint32_t cDevices, uint8_t * pPatternBuffer, uint8_t * pPatternBuffer2, uint32_t cbPatternBuffer, bool fInvert, bool fStream)
+{
+    WS2812 * pThis = (WS2812 *) pWS2812;
+
+    if(fStream)
+    {
+        return(pThis->beginStream(cDevices, pPatternBuffer, cbPatternBuffer, WS2812::timingWS2812B, fInvert));
+    }
+
+    return(pThis->begin(cDevices, pPatternBuffer, pPatternBuffer2, cbPatternBuffer, WS2812::timingWS2812B, fInvert));
+}
+
+/***    template<class T> static bool BeginFixed(WS2812Core * pWS2812, uint32_t cDevices, uint8_t * pPatternBuffer,
+ *                                               uint8_t * pPatternBuffer2, uint32_t cbPatternBuffer, bool fInvert, bool fStream)
+ *
+ *    Description:
+ *
+ *      Begins a WS2812T, the timings are the template's.
+ *
+ * ------------------------------------------------------------ */
+template<class T>
+static bool BeginFixed(WS2812Core * pWS2812, uint32_t cDevices, uint8_t * pPatternBuffer, uint8_t * pPatternBuffer2, uint32_t cbPatternBuffer, bool fInvert, bool fStream)
+{
+    T * pThis = (T *) pWS2812;
+
+    if(fStream)
+    {
+        return(pThis->beginStream(cDevices, pPatternBuffer, cbPatternBuffer, fInvert));
+    }
+
+    return(pThis->begin(cDevices, pPatternBuffer, pPatternBuffer2, cbPatternBuffer, fInvert));
+}
+
+/***    static bool Begin(const CHAIN& chain, uint32_t cDevices, bool fDouble, bool fStream)
+ *
+ *    Parameters:
+ *          chain:      The chain to begin
+ *
+ *          cDevices:   How many devices it has
+ *
+ *          fDouble:    True to give it a second pattern buffer
+ *
+ *          fStream:    True to stream it through the ring
+ *
+ *    Return Values:
+ *          True if begun
+ *
+ *    Description:
+ *
+ *      Begins the chain and points its host driver at the capture
+ *      buffer. Updates are pushed, so a frame is out as soon as it can be.
+ *
+ * ------------------------------------------------------------ */
+static bool Begin(const CHAIN& chain, uint32_t cDevices, bool fDouble, bool fStream)
+{
+    WS2812HostDriver *  pDriver = (WS2812HostDriver *) chain.pWS2812->driver();
+    bool                fBegun  = false;
+
+    chain.pWS2812->setMode32(chain.fMode32);
+    if(fStream)
+    {
+        fBegun = chain.pfnBegin(chain.pWS2812, cDevices, rgbRing, NULL, CBWS2812RING(cDevices), chain.fInvert, true);
+    }
+    else
+    {
+        fBegun = chain.pfnBegin(chain.pWS2812, cDevices, rgbPatternBuffer, fDouble ? rgbPatternBuffer2 : NULL, CBWS2812PATBUF(cDevices), chain.fInvert, false);
+    }
+
+    if(!fBegun)
+    {
+        return(false);
+    }
+
+    pDriver->setCapture(rgbCapture, sizeof(rgbCapture));
+    chain.pWS2812->setFrameDone(FrameDone);
+    chain.pWS2812->setPushOnCommit(true);
+    return(true);
+}
+
+/***    static bool WaitFrame(const CHAIN& chain)
+ *
+ *    Parameters:
+ *          chain:      The chain an update has just been committed on
+ *
+ *    Return Values:
+ *          True once the update is on the chain, false if it never got there
+ *
+ * ------------------------------------------------------------ */
+static bool WaitFrame(const CHAIN& chain)
+{
+    WS2812HostDriver *  pDriver = (WS2812HostDriver *) chain.pWS2812->driver();
+    uint32_t            tStart  = pDriver->now();
+
+    while(!fFrameDone)
+    {
+        if(pDriver->now() - tStart > TICKSTIMEOUT)
+        {
+            return(false);
+        }
+        pDriver->advance(TICKSTEP);
+    }
+
+    return(true);
+}
+
+/***    static bool CheckCapture(const CHAIN& chain, const WS2812::GRB rgGRBWant[], uint32_t cDevices)
+ *
+ *    Parameters:
+ *          chain:      The chain a frame has just gone out on
+ *
+ *          rgGRBWant:  What every device should show
+ *
+ *          cDevices:   How many devices the chain has
+ *
+ *    Return Values:
+ *          True if what went out on SDO decodes to rgGRBWant, inside the timings
+ *
+ * ------------------------------------------------------------ */
+static bool CheckCapture(const CHAIN& chain, const WS2812::GRB rgGRBWant[], uint32_t cDevices)
+{
+    WS2812HostDriver *  pDriver = (WS2812HostDriver *) chain.pWS2812->driver();
+    WS2812Decoder       decoder(chain.pTiming != NULL ? *chain.pTiming : WS2812Decoder::timingMeasured, chain.pWS2812->spiClockRate());
+
+    // the capture is in the order sent, whatever the word order in memory
+    if(decoder.decode(rgbCapture, pDriver->cbCaptured(), chain.fInvert, rgDecoded, cDevices) != cDevices)
+    {
+        return(false);
+    }
+
+    return((chain.pTiming == NULL || decoder.cFaults() == 0) && memcmp(rgDecoded, rgGRBWant, cDevices * sizeof(WS2812::GRB)) == 0);
+}
+
+/***    static uint32_t CaseCompare(const CHAIN& chain, uint32_t cDevices)
+ *
+ *    Description:
+ *
+ *      Full and dirty updates of random frames, the pattern buffer
+ *      checked by WS2812Decoder::compare(), then one frame on the wire.
+ *
+ * ------------------------------------------------------------ */
+static uint32_t CaseCompare(const CHAIN& chain, uint32_t cDevices)
+{
+    WS2812HostDriver *  pDriver = (WS2812HostDriver *) chain.pWS2812->driver();
+    WS2812Decoder       decoder(chain.pTiming != NULL ? *chain.pTiming : WS2812Decoder::timingMeasured, chain.pWS2812->spiClockRate());
+    uint32_t            cFail   = 0;
+
+    // compare() does not move time on, a pushed update would hold the pattern buffer
+    chain.pWS2812->setPushOnCommit(false);
+    cFail = decoder.compare(*chain.pWS2812, rgbPatternBuffer, NULL, NULL, CBWS2812PATBUF(cDevices), chain.fInvert, rgGRB, rgDecoded, cDevices, CFRAMES, Random());
+    if(chain.pTiming != NULL && decoder.cFaults() != 0)
+    {
+        cFail++;
+    }
+
+    // and the last frame again, pushed so it is on the wire as soon as it is out
+    chain.pWS2812->setPushOnCommit(true);
+    fFrameDone = false;
+    while(!chain.pWS2812->updateLEDs(rgGRB))
+    {
+        pDriver->advance(TICKSTEP);
+    }
+
+    if(!WaitFrame(chain) || !CheckCapture(chain, rgGRB, cDevices))
+    {
+        cFail++;
+    }
+
+    return(cFail);
+}
+
+/***    static uint32_t CaseUpdates(const CHAIN& chain, uint32_t cDevices)
+ *
+ *    Description:
+ *
+ *      Full and dirty updates with a random cPass, time moving on
+ *      between calls, every frame checked on the wire. Used for the
+ *      single buffered, double buffered and streamed chains.
+ *
+ * ------------------------------------------------------------ */
+static uint32_t CaseUpdates(const CHAIN& chain, uint32_t cDevices)
+{
+    WS2812HostDriver *  pDriver = (WS2812HostDriver *) chain.pWS2812->driver();
+    uint32_t            cFail   = 0;
+
+    for(uint32_t iFrame = 0; iFrame < CFRAMES; iFrame++)
+    {
+        uint32_t    cPass   = 1 + (Random() % cDevices);
+        uint32_t    iFirst  = 0;
+        uint32_t    cDirty  = cDevices;
+        bool        fDirty  = (iFrame > 0) && ((Random() & 1) != 0);
+
+        if(fDirty)
+        {
+            iFirst  = Random() % cDevices;
+            cDirty  = 1 + (Random() % (cDevices - iFirst));
+            chain.pWS2812->markDirty(iFirst, cDirty);
+        }
+        RandomGRB(&rgGRB[iFirst], cDirty);
+
+        fFrameDone = false;
+        while(!(fDirty ? chain.pWS2812->updateDirtyLEDs(rgGRB, cPass) : chain.pWS2812->updateLEDs(rgGRB, cPass)))
+        {
+            pDriver->advance(TICKSTEP);
+        }
+
+        if(!WaitFrame(chain) || !CheckCapture(chain, rgGRB, cDevices))
+        {
+            cFail++;
+        }
+    }
+
+    return(cFail);
+}
+
+/***    static uint32_t CaseDirty(const CHAIN& chain, uint32_t cDevices)
+ *
+ *    Description:
+ *
+ *      Every pixel changes each frame, but only up to WS2812_DIRTY_RANGES
+ *      short runs are marked dirty; the devices between them must keep 
+ *      what they had. Every fourth frame nothing is marked, and with the
+ *      last frame out updateDirtyLEDsFor() must finish in one call. Used
+ *      for the single and double buffered chains.
+ *
+ * ------------------------------------------------------------ */
+static uint32_t CaseDirty(const CHAIN& chain, uint32_t cDevices)
+{
+    WS2812HostDriver *  pDriver = (WS2812HostDriver *) chain.pWS2812->driver();
+    uint32_t            cFail   = 0;
+
+    RandomGRB(rgExpected, cDevices);
+    fFrameDone = false;
+    while(!chain.pWS2812->updateLEDs(rgExpected, cDevices))
+    {
+        pDriver->advance(TICKSTEP);
+    }
+
+    for(uint32_t iFrame = 0; iFrame < CFRAMES; iFrame++)
+    {
+        uint32_t    cPass   = 1 + (Random() % cDevices);
+        uint32_t    cMarks  = (iFrame % 4) == 3 ? 0 : 1 + (Random() % WS2812_DIRTY_RANGES);
+
+        if(!WaitFrame(chain))
+        {
+            return(cFail + 1);
+        }
+
+        RandomGRB(rgGRB, cDevices);
+        for(uint32_t iMark = 0; iMark < cMarks; iMark++)
+        {
+            uint32_t iFirst = Random() % cDevices;
+            uint32_t cDirty = 1 + (Random() % (cDevices - iFirst < 4 ? cDevices - iFirst : 4));
+
+            chain.pWS2812->markDirty(iFirst, cDirty);
+            memcpy(&rgExpected[iFirst], &rgGRB[iFirst], cDirty * sizeof(WS2812::GRB));
+        }
+
+        fFrameDone = false;
+        if(cMarks == 0)
+        {
+            uint32_t cCalls = 1;
+
+            while(!chain.pWS2812->updateDirtyLEDsFor(rgGRB, 0))
+            {
+                pDriver->advance(TICKSTEP);
+                cCalls++;
+            }
+            cFail += (cCalls > 1) ? 1 : 0;
+        }
+        else
+        {
+            while(!chain.pWS2812->updateDirtyLEDs(rgGRB, cPass))
+            {
+                pDriver->advance(TICKSTEP);
+            }
+        }
+
+        if(!WaitFrame(chain) || !CheckCapture(chain, rgExpected, cDevices))
+        {
+            cFail++;
+        }
+    }
+
+    return(cFail);
+}
+
+/***    static uint32_t CaseLatency(const CHAIN& chain, uint32_t cDevices)
+ *
+ *    Description:
+ *
+ *      Updates sent at the next refresh, as by default. Each update is
+ *      committed as the last one is reported on the chain, so it waits
+ *      about a refresh period to go out; it must be reported as soon as
+ *      it is out, not at the refresh after.
+ *
+ * ------------------------------------------------------------ */
+static uint32_t CaseLatency(const CHAIN& chain, uint32_t cDevices)
+{
+    WS2812HostDriver *  pDriver = (WS2812HostDriver *) chain.pWS2812->driver();
+    uint32_t            cFail   = 0;
+
+    chain.pWS2812->setPushOnCommit(false);
+    for(uint32_t iFrame = 0; iFrame < CFRAMES; iFrame++)
+    {
+        uint32_t tCommit = 0;
+
+        RandomGRB(rgGRB, cDevices);
+
+        fFrameDone = false;
+        while(!chain.pWS2812->updateLEDs(rgGRB, cDevices))
+        {
+            pDriver->advance(TICKSTEP);
+        }
+        tCommit = pDriver->now();
+
+        if(!WaitFrame(chain) || pDriver->now() - tCommit > TICKSLATENCY || !CheckCapture(chain, rgGRB, cDevices))
+        {
+            cFail++;
+        }
+    }
+    chain.pWS2812->setPushOnCommit(true);
+
+    return(cFail);
+}
+
+/***    static uint32_t CaseUnderrun(const CHAIN& chain, uint32_t cDevices)
+ *
+ *    Description:
+ *
+ *      A streamed chain with a ring of CDEVICESHALF devices a half, and
+ *      a DMA interrupt that runs later than a half takes to go out. 
+ *      By then both halves are done, so a chain longer than the ring 
+ *      must stop the refresh, count the underrun, and not report the 
+ *      update until a refresh the interrupt kept up with sends it.
+ *
+ * ------------------------------------------------------------ */
+static uint32_t CaseUnderrun(const CHAIN& chain, uint32_t cDevices)
+{
+    WS2812HostDriver *  pDriver = (WS2812HostDriver *) chain.pWS2812->driver();
+    uint32_t            cFail   = 0;
+    bool                fLonger = cDevices > 2 * CDEVICESHALF;
+    WS2812::STATS       stats;
+
+    chain.pWS2812->end();
+    if(!chain.pfnBegin(chain.pWS2812, cDevices, rgbRing, NULL, CBWS2812RING(CDEVICESHALF), chain.fInvert, true))
+    {
+        return(1);
+    }
+    pDriver->setCapture(rgbCapture, sizeof(rgbCapture));
+    chain.pWS2812->setFrameDone(FrameDone);
+    chain.pWS2812->setPushOnCommit(true);
+
+    for(uint32_t iFrame = 0; iFrame < CFRAMES; iFrame++)
+    {
+        RandomGRB(rgGRB, cDevices);
+
+        pDriver->setInterruptLatency(TICKSLATE);
+        fFrameDone = false;
+        while(!chain.pWS2812->updateLEDs(rgGRB, cDevices))
+        {
+            pDriver->advance(TICKSTEP);
+        }
+        pDriver->advance(TICKSPERREFRESH);
+
+        chain.pWS2812->getStats(&stats);
+        if(fLonger && (fFrameDone || stats.cUnderruns <= iFrame))
+        {
+            cFail++;
+        }
+
+        pDriver->setInterruptLatency(0);
+        if(!WaitFrame(chain) || !CheckCapture(chain, rgGRB, cDevices))
+        {
+            cFail++;
+        }
+    }
+
+    return(cFail);
+}
+
+/***    static uint32_t CaseFill(const CHAIN& chain, uint32_t cDevices)
+ *
+ *    Description:
+ *
+ *      fillLEDs() and repeatLEDs() over random ranges of the chain.
+ *
+ * ------------------------------------------------------------ */
+static uint32_t CaseFill(const CHAIN& chain, uint32_t cDevices)
+{
+    WS2812HostDriver *  pDriver = (WS2812HostDriver *) chain.pWS2812->driver();
+    uint32_t            cFail   = 0;
+
+    RandomGRB(rgExpected, cDevices);
+    fFrameDone = false;
+    while(!chain.pWS2812->updateLEDs(rgExpected))
+    {
+        pDriver->advance(TICKSTEP);
+    }
+
+    for(uint32_t iFrame = 0; iFrame < CFRAMES; iFrame++)
+    {
+        uint32_t    iFirst      = Random() % cDevices;
+        uint32_t    cFill       = 1 + (Random() % (cDevices - iFirst));
+        uint32_t    cPattern    = 1 + (Random() % 5);
+        bool        fRepeat     = (Random() & 1) != 0;
+
+        if(!WaitFrame(chain))
+        {
+            return(cFail + 1);
+        }
+
+        RandomGRB(rgGRB, cPattern);
+        for(uint32_t i = 0; i < cFill; i++)
+        {
+            rgExpected[iFirst + i] = rgGRB[fRepeat ? (i % cPattern) : 0];
+        }
+
+        fFrameDone = false;
+        while(!(fRepeat ? chain.pWS2812->repeatLEDs(rgGRB, cPattern, iFirst, cFill) : chain.pWS2812->fillLEDs(rgGRB[0], iFirst, cFill)))
+        {
+            pDriver->advance(TICKSTEP);
+        }
+
+        if(!WaitFrame(chain) || !CheckCapture(chain, rgExpected, cDevices))
+        {
+            cFail++;
+        }
+    }
+
+    return(cFail);
+}
+
+/***    static uint32_t CaseScroll(const CHAIN& chain, uint32_t cDevices)
+ *
+ *    Description:
+ *
+ *      scrollLEDs() both ways, rotating or moving new pixels on.
+ *
+ * ------------------------------------------------------------ */
+static uint32_t CaseScroll(const CHAIN& chain, uint32_t cDevices)
+{
+    WS2812HostDriver *  pDriver = (WS2812HostDriver *) chain.pWS2812->driver();
+    uint32_t            cFail   = 0;
+
+    RandomGRB(rgExpected, cDevices);
+    fFrameDone = false;
+    while(!chain.pWS2812->updateLEDs(rgExpected))
+    {
+        pDriver->advance(TICKSTEP);
+    }
+
+    for(uint32_t iFrame = 0; iFrame < CFRAMES; iFrame++)
+    {
+        int32_t     cShift  = (int32_t) (Random() % cDevices) - (int32_t) (cDevices / 2);
+        bool        fRotate = (Random() & 1) != 0;
+
+        if(!WaitFrame(chain))
+        {
+            return(cFail + 1);
+        }
+
+        // device i shows what device i - cShift showed, or the new pixel there
+        RandomGRB(rgGRB, cDevices);
+        for(uint32_t i = 0; i < cDevices; i++)
+        {
+            int32_t iFrom = (int32_t) i - cShift;
+
+            if(iFrom >= 0 && iFrom < (int32_t) cDevices)
+            {
+                rgDecoded[i] = rgExpected[iFrom];
+            }
+            else
+            {
+                rgDecoded[i] = fRotate ? rgExpected[(iFrom + cDevices) % cDevices] : rgGRB[i];
+            }
+        }
+        memcpy(rgExpected, rgDecoded, cDevices * sizeof(WS2812::GRB));
+
+        fFrameDone = false;
+        while(!(fRotate ? chain.pWS2812->scrollLEDs(cShift) : chain.pWS2812->scrollLEDs(cShift, rgGRB)))
+        {
+            pDriver->advance(TICKSTEP);
+        }
+
+        if(!WaitFrame(chain) || !CheckCapture(chain, rgExpected, cDevices))
+        {
+            cFail++;
+        }
+    }
+
+    return(cFail);
+}
+
+/***    static uint32_t CasePalette(const CHAIN& chain, uint32_t cDevices)
+ *
+ *    Description:
+ *
+ *      Indexed updates, full and dirty, from a random palette.
+ *
+ * ------------------------------------------------------------ */
+static uint32_t CasePalette(const CHAIN& chain, uint32_t cDevices)
+{
+    WS2812HostDriver *  pDriver = (WS2812HostDriver *) chain.pWS2812->driver();
+    uint32_t            cFail   = 0;
+
+    RandomGRB(rgPalette, CPALETTE);
+    if(!chain.pWS2812->setPalette(rgPalette, CPALETTE, rgbSymbols, sizeof(rgbSymbols)))
+    {
+        return(1);
+    }
+
+    for(uint32_t iFrame = 0; iFrame < CFRAMES; iFrame++)
+    {
+        uint32_t    cPass   = 1 + (Random() % cDevices);
+        uint32_t    iFirst  = 0;
+        uint32_t    cDirty  = cDevices;
+        bool        fDirty  = (iFrame > 0) && ((Random() & 1) != 0);
+
+        if(fDirty)
+        {
+            iFirst  = Random() % cDevices;
+            cDirty  = 1 + (Random() % (cDevices - iFirst));
+            chain.pWS2812->markDirty(iFirst, cDirty);
+        }
+
+        for(uint32_t i = iFirst; i < iFirst + cDirty; i++)
+        {
+            rgIndex[i] = (uint8_t) (Random() % CPALETTE);
+        }
+
+        for(uint32_t i = 0; i < cDevices; i++)
+        {
+            rgExpected[i] = rgPalette[rgIndex[i]];
+        }
+
+        fFrameDone = false;
+        while(!(fDirty ? chain.pWS2812->updateDirtyIndexedLEDs(rgIndex, cPass) : chain.pWS2812->updateIndexedLEDs(rgIndex, cPass)))
+        {
+            pDriver->advance(TICKSTEP);
+        }
+
+        if(!WaitFrame(chain) || !CheckCapture(chain, rgExpected, cDevices))
+        {
+            cFail++;
+        }
+    }
+
+    chain.pWS2812->setPalette(NULL, 0, NULL, 0);
+    return(cFail);
+}
+
+/***    static uint32_t CaseEarly(const CHAIN& chain, uint32_t cDevices)
+ *
+ *    Description:
+ *
+ *      Updates that start the refresh early, one device a call. The
+ *      calls come faster than the devices go out, so the DMA must never
+ *      catch up with the conversion. Push is off, an early start must
+ *      push its own refresh; a chain no longer than the lead never
+ *      starts early and is pushed as usual.
+ *
+ * ------------------------------------------------------------ */
+static uint32_t CaseEarly(const CHAIN& chain, uint32_t cDevices)
+{
+    WS2812HostDriver *  pDriver = (WS2812HostDriver *) chain.pWS2812->driver();
+    uint32_t            cFail   = 0;
+    WS2812::STATS       stats;
+
+    chain.pWS2812->setPushOnCommit(cDevices <= CEARLY);
+    chain.pWS2812->setEarlyStart(CEARLY);
+    for(uint32_t iFrame = 0; iFrame < CFRAMES; iFrame++)
+    {
+        RandomGRB(rgGRB, cDevices);
+
+        fFrameDone = false;
+        while(!chain.pWS2812->updateLEDs(rgGRB, 1))
+        {
+            pDriver->advance(TICKSTEP);
+        }
+
+        if(!WaitFrame(chain) || !CheckCapture(chain, rgGRB, cDevices))
+        {
+            cFail++;
+        }
+    }
+    chain.pWS2812->setEarlyStart(0);
+    chain.pWS2812->setPushOnCommit(true);
+
+    chain.pWS2812->getStats(&stats);
+    return(cFail + stats.cCaught);
+}
+
+/***    static uint32_t RunCase(const CHAIN& chain, const char * szCase, PFNCASE pfnCase, bool fDouble, bool fStream)
+ *
+ *    Parameters:
+ *          chain:      The chain to check
+ *
+ *          szCase:     What to call the case
+ *
+ *          pfnCase:    The case
+ *
+ *          fDouble:    Begin the chain double buffered
+ *
+ *          fStream:    Begin the chain streamed
+ *
+ *    Return Values:
+ *          The number of chain lengths the case failed at
+ *
+ * ------------------------------------------------------------ */
+static uint32_t RunCase(const CHAIN& chain, const char * szCase, PFNCASE pfnCase, bool fDouble, bool fStream)
+{
+    static const uint32_t rgcDevices[] = { 1, 7, CDEVICESMAX };
+    uint32_t cFailed = 0;
+
+    for(uint32_t iDevices = 0; iDevices < ELEMENTS(rgcDevices); iDevices++)
+    {
+        uint32_t cDevices   = rgcDevices[iDevices];
+        uint32_t cFail      = 0;
+
+        if(!Begin(chain, cDevices, fDouble, fStream))
+        {
+            printf("FAIL  %-24s %-10s %2u devices: begin() failed\n", chain.szName, szCase, cDevices);
+            cFailed++;
+            continue;
+        }
+
+        cFail = pfnCase(chain, cDevices);
+        chain.pWS2812->end();
+
+        if(cFail != 0)
+        {
+            printf("FAIL  %-24s %-10s %2u devices: %u frames\n", chain.szName, szCase, cDevices, cFail);
+            cFailed++;
+        }
+    }
+
+    if(cFailed == 0)
+    {
+        printf("ok    %-24s %s\n", chain.szName, szCase);
+    }
+
+    return(cFailed);
+}
+
+int main(int argc, char * argv[])
+{
+    const CHAIN rgChain[] =
+    {
+        { "WS2812 4,3,1",           &ws2812Table,           BeginTable,                 false,  false,  &WS2812Decoder::timingMeasured  },
+        { "WS2812 4,3,1 inverted",  &ws2812TableInverted,   BeginTable,                 true,   false,  &WS2812Decoder::timingMeasured  },
+        { "WS2812 4,3,1 MODE32",    &ws2812TableMode32,     BeginTable,                 false,  true,   &WS2812Decoder::timingMeasured  },
+        { "WS2812 timingWS2812B",   &ws2812Timing,          BeginTiming,                false,  false,  &WS2812Decoder::timingWS2812B   },
+        { "WS2812T<>",              &ws2812Fixed,           BeginFixed<WS2812T<> >,     false,  false,  &WS2812Decoder::timingMeasured  },
+        // 3 clocks at the default SPI clock is a 1uS bit, shorter than any of the timings
+        { "WS2812T<3,2,1>",         &ws2812Fixed3,          BeginFixed<WS2812T<3, 2, 1> >, false, false, NULL              },
+        { "WS2812T<> inverted",     &ws2812FixedInverted,   BeginFixed<WS2812T<> >,     true,   false,  &WS2812Decoder::timingMeasured  },
+        { "WS2812T<> MODE32",       &ws2812FixedMode32,     BeginFixed<WS2812T<> >,     false,  true,   &WS2812Decoder::timingMeasured  },
+    };
+    uint32_t cFailed = 0;
+
+    randomState = (argc > 1) ? (uint32_t) strtoul(argv[1], NULL, 0) : 1;
+    if(randomState == 0)
+    {
+        randomState = 1;
+    }
+
+    for(uint32_t iChain = 0; iChain < ELEMENTS(rgChain); iChain++)
+    {
+        const CHAIN& chain = rgChain[iChain];
+
+        cFailed += RunCase(chain, "compare",    CaseCompare,    false,  false);
+        cFailed += RunCase(chain, "updates",    CaseUpdates,    false,  false);
+        cFailed += RunCase(chain, "double",     CaseUpdates,    true,   false);
+        cFailed += RunCase(chain, "stream",     CaseUpdates,    false,  true);
+        cFailed += RunCase(chain, "dirty",      CaseDirty,      false,  false);
+        cFailed += RunCase(chain, "dirty dbl",  CaseDirty,      true,   false);
+        cFailed += RunCase(chain, "latency",    CaseLatency,    false,  false);
+        cFailed += RunCase(chain, "lat stream", CaseLatency,    false,  true);
+        cFailed += RunCase(chain, "underrun",   CaseUnderrun,   false,  true);
+        cFailed += RunCase(chain, "fill",       CaseFill,       false,  false);
+        cFailed += RunCase(chain, "scroll",     CaseScroll,     false,  false);
+        cFailed += RunCase(chain, "palette",    CasePalette,    false,  false);
+        cFailed += RunCase(chain, "early",      CaseEarly,      false,  false);
+    }
+
+    printf("%u failed\n", cFailed);
+    return(cFailed != 0 ? 1 : 0);
+}
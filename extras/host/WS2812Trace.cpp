@@ -0,0 +1,259 @@
+/************************************************************************/
+/*                                                                      */
+/*    WS2812Trace.cpp                                                   */
+/*                                                                      */
+/*    Turns what WS2812Core::dumpTrace() wrote into a timeline          */
+/*                                                                      */
+/************************************************************************/
+/*
+*
+* Copyright (c) 2014, Digilent <www.digilentinc.com>
+* Contact Digilent for the latest version.
+*
+* This program is free software; distributed under the terms of
+* BSD 3-clause license ("Revised BSD License", "New BSD License", or "Modified BSD License")
+*
+* Redistribution and use in source and binary forms, with or without modification,
+* are permitted provided that the following conditions are met:
+*
+* 1.    Redistributions of source code must retain the above copyright notice, this
+*        list of conditions and the following disclaimer.
+* 2.    Redistributions in binary form must reproduce the above copyright notice,
+*        this list of conditions and the following disclaimer in the documentation
+*        and/or other materials provided with the distribution.
+* 3.    Neither the name(s) of the above-listed copyright holder(s) nor the names
+*        of its contributors may be used to endorse or promote products derived
+*        from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+* IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+* BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+* LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+* OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/************************************************************************/
+/*                                                                      */
+/*  Reads a capture of the serial port, or any file, with one or more   */
+/*  dumps in it; whatever else the sketch printed around them is        */
+/*  skipped. Each dump is printed as one event per line, times in uS    */
+/*  from its first event.                                               */
+/*                                                                      */
+/*  From the library folder:                                            */
+/*                                                                      */
+/*    g++ -std=gnu++11 -O2 -DWS2812_HOST -I. extras/host/WS2812Trace.cpp */
+/*        -o WS2812Trace                                                */
+/*    ./WS2812Trace capture.bin                                         */
+/*                                                                      */
+/*  Writes a line per event to stdout:                                  */
+/*                                                                      */
+/*    us            time since the first event of the dump              */
+/*    +us           time since the event before                         */
+/*    event         WS2812_TRACE_* without the prefix                   */
+/*    detail        what arg8 and arg say about it                      */
+/*                                                                      */
+/************************************************************************/
+#include <WS2812Driver.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+static const char * const rgszState[] = { "INIT", "WAITUPD", "CONVGRB", "ENDUPD" };
+
+/***    static const char * StateName(uint32_t state)
+ *
+ *    Parameters:
+ *          state:  An update state from a WS2812_TRACE_STATE event
+ *
+ *    Return Values:
+ *          Its name
+ *
+ * ------------------------------------------------------------ */
+static const char * StateName(uint32_t state)
+{
+    return(state < sizeof(rgszState) / sizeof(rgszState[0]) ? rgszState[state] : "?");
+}
+
+/***    static uint32_t ReadU32(const uint8_t * pb)
+ *
+ *    Parameters:
+ *          pb:     4 bytes, little endian as the PIC32 wrote them
+ *
+ *    Return Values:
+ *          The value, whatever the host is
+ *
+ * ------------------------------------------------------------ */
+static uint32_t ReadU32(const uint8_t * pb)
+{
+    return(pb[0] | (pb[1] << 8) | (pb[2] << 16) | ((uint32_t) pb[3] << 24));
+}
+
+/***    static void PrintEvent(const uint8_t * pb)
+ *
+ *    Parameters:
+ *          pb:     A WS2812EVENT as dumped
+ *
+ *    Return Values:
+ *          None
+ *
+ *    Description:
+ *
+ *      Prints the name and what the arguments mean, the times are
+ *      already out.
+ *
+ * ------------------------------------------------------------ */
+static void PrintEvent(const uint8_t * pb)
+{
+    uint32_t event  = pb[4];
+    uint32_t arg8   = pb[5];
+    uint32_t arg    = pb[6] | (pb[7] << 8);
+
+    switch(event)
+    {
+        case WS2812_TRACE_STATE:
+            printf("STATE      %s -> %s%s%s\n", StateName(arg & 0xFF), StateName(arg8),
+                (arg & 0x100) != 0 ? " fill" : "", (arg & 0x200) != 0 ? " scroll" : "");
+            break;
+
+        case WS2812_TRACE_REFUSED:
+            printf("REFUSED    %s\n", arg8 ? "back buffer not swapped in yet" : "pattern buffer streaming");
+            break;
+
+        case WS2812_TRACE_ABORT:
+            printf("ABORT      %u devices left\n", arg);
+            break;
+
+        case WS2812_TRACE_COMMIT:
+            printf("COMMIT     %u devices%s\n", arg, arg8 ? ", swapped" : "");
+            break;
+
+        case WS2812_TRACE_DMAON:
+            printf("DMAON      %s\n", arg8 ? "new update" : "refresh");
+            break;
+
+        case WS2812_TRACE_DMAOFF:
+            printf("DMAOFF\n");
+            break;
+
+        case WS2812_TRACE_LATE:
+            printf("LATE      %s%s%s%s\n",
+                (arg8 & WS2812_LATE_UPDATING) != 0 ? " updating" : "",
+                (arg8 & WS2812_LATE_NEWFRAME) != 0 ? " last-update-not-out" : "",
+                (arg8 & WS2812_LATE_DMA) != 0 ? " dma-busy" : "",
+                (arg8 & WS2812_LATE_GAP) != 0 ? " reset-period" : "");
+            break;
+
+        case WS2812_TRACE_FRAMEDONE:
+            printf("FRAMEDONE\n");
+            break;
+
+        case WS2812_TRACE_EARLY:
+            printf("EARLY      refresh let go, %u devices converted\n", arg);
+            break;
+
+        case WS2812_TRACE_UNDERRUN:
+            printf("UNDERRUN   streamed refresh stopped after %u ring halves\n", arg);
+            break;
+
+        default:
+            printf("?%-9u %u %u\n", event, arg8, arg);
+            break;
+    }
+}
+
+/***    static uint32_t PrintDump(const uint8_t * pb, uint32_t cb)
+ *
+ *    Parameters:
+ *          pb:     A WS2812TRACEHDR and the events after it
+ *
+ *          cb:     The bytes from pb to the end of the capture
+ *
+ *    Return Values:
+ *          The bytes of the dump, or 0 if it was cut short
+ *
+ * ------------------------------------------------------------ */
+static uint32_t PrintDump(const uint8_t * pb, uint32_t cb)
+{
+    uint32_t    cWritten    = ReadU32(pb + 4);
+    uint32_t    cEvents     = ReadU32(pb + 8);
+    uint32_t    tickRate    = ReadU32(pb + 12);
+    uint32_t    tFirst      = 0;
+    uint32_t    tLast       = 0;
+    uint32_t    i;
+
+    if(tickRate == 0 || cEvents > (cb - sizeof(WS2812TRACEHDR)) / sizeof(WS2812EVENT))
+    {
+        printf("# dump cut short\n");
+        return(0);
+    }
+
+    printf("# %u events, %u written over, %u core timer ticks per mS\n", cEvents, cWritten - cEvents, tickRate);
+    printf("%12s %10s  event\n", "us", "+us");
+
+    pb += sizeof(WS2812TRACEHDR);
+    for(i = 0; i < cEvents; i++, pb += sizeof(WS2812EVENT))
+    {
+        uint32_t t = ReadU32(pb);
+
+        if(i == 0)
+        {
+            tFirst  = t;
+            tLast   = t;
+        }
+
+        // events are in the order their slots were taken, which an interrupt can swap by a little
+        printf("%12.1f %+10.1f  ", ((uint32_t) (t - tFirst) * 1000.0) / tickRate, ((int32_t) (t - tLast) * 1000.0) / tickRate);
+        PrintEvent(pb);
+        tLast = t;
+    }
+
+    return(sizeof(WS2812TRACEHDR) + (cEvents * sizeof(WS2812EVENT)));
+}
+
+int main(int argc, char * argv[])
+{
+    FILE *                  pFile   = (argc > 1) ? fopen(argv[1], "rb") : stdin;
+    std::vector<uint8_t>    rgb;
+    uint8_t                 rgbRead[4096];
+    size_t                  cbRead;
+    uint32_t                ib      = 0;
+    uint32_t                cDumps  = 0;
+
+    if(pFile == NULL)
+    {
+        fprintf(stderr, "usage: WS2812Trace [capture]\n");
+        return(1);
+    }
+
+    while((cbRead = fread(rgbRead, 1, sizeof(rgbRead), pFile)) > 0)
+    {
+        rgb.insert(rgb.end(), rgbRead, rgbRead + cbRead);
+    }
+
+    // every "WST1" with a whole header after it is a dump
+    while(ib + sizeof(WS2812TRACEHDR) <= rgb.size())
+    {
+        uint32_t cbDump = 0;
+
+        if(rgb[ib] == 'W' && rgb[ib + 1] == 'S' && rgb[ib + 2] == 'T' && rgb[ib + 3] == '1')
+        {
+            printf("%s# dump %u at byte %u\n", cDumps > 0 ? "\n" : "", cDumps, ib);
+            cDumps++;
+            cbDump = PrintDump(&rgb[ib], rgb.size() - ib);
+        }
+
+        ib += (cbDump != 0) ? cbDump : 1;
+    }
+
+    if(cDumps == 0)
+    {
+        fprintf(stderr, "no trace dump found\n");
+        return(1);
+    }
+
+    return(0);
+}